@@ -6,43 +6,47 @@
 #define AABB_H
 #include "interval.h"
 
-class aabb
+template <typename T>
+class basic_aabb
 {
 public:
-    interval x, y, z;
-    aabb() = default; //default aabb is empty bc intervals empty by default
-    aabb(const interval& x, const interval& y, const interval& z) : x(x), y(y), z(z)
+    using interval_t = basic_interval<T>;
+    using point_t = basic_vec3<T>;
+
+    interval_t x, y, z;
+    basic_aabb() = default; //default aabb is empty bc intervals empty by default
+    basic_aabb(const interval_t& x, const interval_t& y, const interval_t& z) : x(x), y(y), z(z)
     {
         pad_to_minimum();
     };
 
-    aabb(const point3& a, const point3& b)
+    basic_aabb(const point_t& a, const point_t& b)
     {
         //treat a and b as extrema for bounding box
-        x = (a[0] <= b[0]) ? interval(a[0],b[0]) : interval(b[0],a[0]);
-        y = (a[1] <= b[1]) ? interval(a[1],b[1]) : interval(b[1],a[1]);
-        z = (a[2] <= b[2]) ? interval(a[2],b[2]) : interval(b[2],a[2]);
+        x = (a[0] <= b[0]) ? interval_t(a[0],b[0]) : interval_t(b[0],a[0]);
+        y = (a[1] <= b[1]) ? interval_t(a[1],b[1]) : interval_t(b[1],a[1]);
+        z = (a[2] <= b[2]) ? interval_t(a[2],b[2]) : interval_t(b[2],a[2]);
 
         pad_to_minimum();
     }
-    aabb(const aabb& b1, const aabb& b2){
-        x = interval(b1.x, b2.x);
-        y = interval(b1.y, b2.y);
-        z = interval(b1.z, b2.z);
+    basic_aabb(const basic_aabb& b1, const basic_aabb& b2){
+        x = interval_t(b1.x, b2.x);
+        y = interval_t(b1.y, b2.y);
+        z = interval_t(b1.z, b2.z);
     }
-    const interval& axis_interval(int n) const
+    const interval_t& axis_interval(int n) const
     {
         if (n == 0) return x;
         if (n == 1) return y;
         return z;
     }
-    bool hit(const ray& r, interval ray_t) const //2nd paran is the time interval the ray spends in the aabb
+    bool hit(const basic_ray<T>& r, interval_t ray_t) const //2nd paran is the time interval the ray spends in the aabb
     {
-        const point3& origin = r.origin();
-        const point3& direction = r.direction();
+        const point_t& origin = r.origin();
+        const point_t& direction = r.direction();
 
         for (int axis = 0; axis < 3; axis++){
-            const interval& ax = axis_interval(axis);
+            const interval_t& ax = axis_interval(axis);
 
             auto t_enter = (ax.min - origin[axis])/direction[axis];
             auto t_exit = (ax.max - origin[axis])/direction[axis];
@@ -53,6 +57,8 @@ public:
                 t_enter = t_exit;
                 t_exit = temp;
             }
+            //pad the exit by the rounding error of the two ops above so grazing rays aren't culled (pbrt 6.8.2)
+            t_exit *= 1 + 2 * std::numeric_limits<T>::epsilon() * 3;
             if (t_enter > ray_t.min) ray_t.min = t_enter;
             if (t_exit < ray_t.max) ray_t.max = t_exit;
 
@@ -66,12 +72,12 @@ public:
         if (x.size() > y.size()) return x.size() > z.size() ? 0 : 2;
         else return y.size() > z.size() ? 1 : 2;
     }
-    double surface_area() const
+    T surface_area() const
     {
         return 2*(x.size()*y.size() + x.size()*z.size() + y.size()*z.size());
     }
-    static const aabb empty, universe;
-    point3 get_centroid() const
+    static const basic_aabb empty, universe;
+    point_t get_centroid() const
     {
         return {(x.min + x.max)/2, (y.min + y.max)/2, (z.min + z.max)/2};
     }
@@ -79,23 +85,29 @@ private:
     void pad_to_minimum()
     {
         //adjust aabb so no side is narrower than some delta
-        double delta = 0.0001;
+        T delta = 0.0001;
         if (x.size() < delta) x = x.expand(delta);
         if (y.size() < delta) y = y.expand(delta);
         if (z.size() < delta) z = z.expand(delta);
     }
 };
 
-const aabb aabb::empty = aabb(interval::empty, interval::empty, interval::empty);
-const aabb aabb::universe = aabb(interval::universe, interval::universe, interval::universe);
+template <typename T>
+const basic_aabb<T> basic_aabb<T>::empty = basic_aabb<T>(basic_interval<T>::empty, basic_interval<T>::empty, basic_interval<T>::empty);
+template <typename T>
+const basic_aabb<T> basic_aabb<T>::universe = basic_aabb<T>(basic_interval<T>::universe, basic_interval<T>::universe, basic_interval<T>::universe);
 
-aabb operator+(const aabb& bbox, const vec3& offset)
+template <typename T>
+basic_aabb<T> operator+(const basic_aabb<T>& bbox, const basic_vec3<T>& offset)
 {
-    return aabb(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
+    return basic_aabb<T>(bbox.x + offset.x(), bbox.y + offset.y(), bbox.z + offset.z());
 }
-aabb operator+(const vec3& offset, const aabb& bbox)
+template <typename T>
+basic_aabb<T> operator+(const basic_vec3<T>& offset, const basic_aabb<T>& bbox)
 {
     return bbox + offset;
 }
 
+using aabb = basic_aabb<real>;
+
 #endif //AABB_H
@@ -0,0 +1,89 @@
+//
+// Created by Faye Yu on 1/23/26.
+//
+
+#ifndef ALIAS_TABLE_H
+#define ALIAS_TABLE_H
+
+#include <algorithm>
+#include <span>
+#include <vector>
+
+class alias_table
+{
+/*
+ * samples an index in proportion to its weight in O(1), no matter how many there are (Vose's alias method).
+ * every bin holds one index with probability q and an alias for the rest, so a sample is one bin pick and one compare.
+ * weights that are all zero (or none at all) fall back to uniform
+ */
+public:
+    alias_table() = default;
+    explicit alias_table(std::span<const double> weights)
+    {
+        size_t n = weights.size();
+        if (n == 0) return;
+        bins.resize(n);
+
+        double total = 0;
+        for (double w : weights) total += std::max(0.0, w);
+        for (size_t i = 0; i < n; i++)
+        {
+            bins[i].pmf = total > 0 ? std::max(0.0, weights[i]) / total : 1.0 / n;
+        }
+
+        //split bins into ones under and over the average, then top up each small one from a big one
+        std::vector<int> small, large;
+        std::vector<double> scaled(n);
+        for (size_t i = 0; i < n; i++)
+        {
+            scaled[i] = bins[i].pmf * n;
+            (scaled[i] < 1 ? small : large).push_back(int(i));
+        }
+        while (!small.empty() && !large.empty())
+        {
+            int s = small.back(), l = large.back();
+            small.pop_back();
+            large.pop_back();
+            bins[s].q = scaled[s];
+            bins[s].alias = l;
+            scaled[l] -= 1 - scaled[s];
+            (scaled[l] < 1 ? small : large).push_back(l);
+        }
+        //whatever is left is 1 up to rounding
+        for (int i : small) bins[i].q = 1;
+        for (int i : large) bins[i].q = 1;
+    }
+
+    size_t size() const { return bins.size(); }
+    bool empty() const { return bins.empty(); }
+
+    /**
+     * @param u uniform in [0, 1)
+     * @param pmf set to the chance of the returned index
+     * @return the index, or -1 if the table is empty
+     */
+    int sample(double u, double& pmf) const
+    {
+        if (bins.empty())
+        {
+            pmf = 0;
+            return -1;
+        }
+        double scaled = u * bins.size();
+        int i = std::min(int(scaled), int(bins.size()) - 1);
+        int chosen = scaled - i < bins[i].q ? i : bins[i].alias;
+        pmf = bins[chosen].pmf;
+        return chosen;
+    }
+    double pmf(int i) const { return bins[i].pmf; }
+private:
+    struct bin
+    {
+        double q = 1; //chance of keeping this bin's own index
+        int alias = 0;
+        double pmf = 0; //chance of this index overall
+    };
+    std::vector<bin> bins;
+};
+
+#endif //ALIAS_TABLE_H
@@ -0,0 +1,244 @@
+//
+// Created by Faye Yu on 1/17/26.
+//
+
+#ifndef ASSET_MANAGER_H
+#define ASSET_MANAGER_H
+
+#include <atomic>
+#include <chrono>
+#include <exception>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include "obj_loader.h"
+#include "ply_loader.h"
+
+class asset_manager
+{
+/*
+ * finds mesh assets (.obj and .ply) by file name and loads each one once.
+ * loads run on background threads, so several meshes parse and build their bvhs at the same time
+ * while the caller keeps setting up the scene, and get() on the handle waits for the one it needs.
+ * geometry is shared by content: the same file asked for twice, or two files with identical bytes,
+ * are loaded once. every get() binds materials to its own triangle_mesh::share() of that geometry, which copies
+ * nothing but the slot table, so meshes never outlive the registry their material ids came from.
+ * the cores are split between the obj loads running at once instead of each one using all of them
+ */
+    //what a background load produces, before any materials are chosen
+    struct loaded_asset
+    {
+        shared_ptr<const triangle_mesh> geometry;
+        mesh_file::slot_names names;
+        std::string folder; //where the file is, for its mtl files
+    };
+
+    struct material_binding
+    {
+        material_registry* registry = nullptr; //the mtl materials go here, or every slot is fallback if null
+        material_id fallback = 0;
+    };
+    using asset_future = std::shared_future<shared_ptr<const loaded_asset>>;
+
+public:
+    asset_manager() = default;
+    explicit asset_manager(const std::string& folder_path) { add_folder(folder_path); }
+    //pending loads point back at the manager
+    asset_manager(const asset_manager&) = delete;
+    asset_manager& operator=(const asset_manager&) = delete;
+    ~asset_manager() { wait(); }
+
+    //a mesh that may still be loading
+    class handle
+    {
+    public:
+        handle() = default;
+        bool valid() const { return asset.valid(); }
+        bool ready() const { return asset.wait_for(std::chrono::seconds(0)) == std::future_status::ready; }
+        /**
+         * Waits for the load and gives the mesh its materials. materials are added to the registry here,
+         * on the calling thread, so call it from the thread setting up the scene
+         * @return the mesh, or nullptr if the asset couldn't be loaded
+         */
+        shared_ptr<triangle_mesh> get() const
+        {
+            if (!manager) return nullptr;
+            return manager->bind(asset.get(), binding);
+        }
+    private:
+        friend class asset_manager;
+        asset_manager* manager = nullptr;
+        asset_future asset;
+        material_binding binding;
+    };
+
+    //indexes every .obj and .ply in the folder, a file name that's already indexed keeps its first path
+    void add_folder(const std::string& folder_path)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (auto const& entry : fs::directory_iterator(folder_path))
+        {
+            std::string ext = entry.path().extension().string();
+            if (!entry.is_regular_file() || (ext != ".obj" && ext != ".ply")) continue;
+            auto [it, added] = paths.emplace(entry.path().filename().string(), entry.path().string());
+            if (!added && it->second != entry.path().string())
+            {
+                std::clog << "Two assets named " << it->first << ", using " << it->second << std::endl;
+            }
+        }
+    }
+
+    bool contains(const std::string& name) const
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        return paths.contains(name);
+    }
+
+    /**
+     * Starts loading an asset in the background and returns right away
+     * @param name file name of an indexed asset, or a path to one
+     * @param mat the material to make this mesh, usemtl groups are ignored
+     * @param quantize store the mesh's vertices in the compact quantized format
+     */
+    handle load_async(const std::string& name, material_id mat, bool quantize = false)
+    {
+        material_binding binding;
+        binding.fallback = mat;
+        return start(name, quantize, binding);
+    }
+    /**
+     * Starts loading an asset in the background with the materials from its mtl files, see obj_loader::load().
+     * assets without material names (ex: ply) get the fallback everywhere
+     * @param name file name of an indexed asset, or a path to one
+     * @param materials the scene's registry, materials are added to it when the handle's get() is called
+     * @param fallback
+     * @param quantize store the mesh's vertices in the compact quantized format
+     */
+    handle load_async(const std::string& name, material_registry& materials, material_id fallback, bool quantize = false)
+    {
+        material_binding binding;
+        binding.registry = &materials;
+        binding.fallback = fallback;
+        return start(name, quantize, binding);
+    }
+
+    shared_ptr<triangle_mesh> load(const std::string& name, material_id mat, bool quantize = false)
+    {
+        return load_async(name, mat, quantize).get();
+    }
+    shared_ptr<triangle_mesh> load(const std::string& name, material_registry& materials, material_id fallback,
+                                   bool quantize = false)
+    {
+        return load_async(name, materials, fallback, quantize).get();
+    }
+
+    //blocks until every load started so far is done
+    void wait()
+    {
+        std::vector<asset_future> pending;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto& [key, asset] : by_path) pending.push_back(asset);
+        }
+        for (const auto& asset : pending) asset.wait();
+    }
+private:
+    mutable std::mutex mutex;
+    std::unordered_map<std::string, std::string> paths; //file name -> path
+    std::map<std::pair<std::string, bool>, asset_future> by_path; //(path, quantize)
+    std::map<std::pair<std::uint64_t, bool>, asset_future> by_content; //(hash of the file, quantize)
+    std::atomic<unsigned> parsing{0}; //obj loads parsing right now, they share the cores
+
+    handle start(const std::string& name, bool quantize, const material_binding& binding)
+    {
+        handle h;
+        h.manager = this;
+        h.binding = binding;
+
+        std::lock_guard<std::mutex> lock(mutex);
+        auto found = paths.find(name);
+        std::string path = found != paths.end() ? found->second : name;
+        auto [it, added] = by_path.try_emplace({path, quantize});
+        if (added)
+        {
+            it->second = std::async(std::launch::async, [this, path, quantize]{ return load_asset(path, quantize); }).share();
+        }
+        h.asset = it->second;
+        return h;
+    }
+
+    //runs on a background thread
+    shared_ptr<const loaded_asset> load_asset(const std::string& path, bool quantize)
+    {
+        std::uint64_t hash;
+        {
+            mapped_file file(path);
+            if (!file.is_open()) return nullptr;
+            hash = mesh_file::hash_bytes(std::span<const std::byte>(file.data(), file.size()));
+        }
+
+        //the first load of these bytes does the work, a copy under another path waits for it
+        std::promise<shared_ptr<const loaded_asset>> promise;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto [it, added] = by_content.try_emplace({hash, quantize});
+            if (!added)
+            {
+                asset_future same = it->second;
+                lock.unlock();
+                return same.get();
+            }
+            it->second = promise.get_future().share();
+        }
+
+        try
+        {
+            auto asset = make_shared<loaded_asset>();
+            asset->folder = fs::path(path).parent_path().string();
+            if (fs::path(path).extension().string() == ".ply")
+            {
+                asset->geometry = ply_loader::load_file(path, 0, quantize);
+            }
+            else
+            {
+                unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+                unsigned threads = std::max(1u, cores / ++parsing);
+                struct done_parsing
+                {
+                    std::atomic<unsigned>& count;
+                    ~done_parsing() { count--; }
+                } done{parsing};
+                asset->geometry = obj_loader().load_file(path, quantize, threads, asset->names);
+            }
+            shared_ptr<const loaded_asset> result = asset->geometry ? asset : nullptr;
+            promise.set_value(result);
+            return result;
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+
+    shared_ptr<triangle_mesh> bind(const shared_ptr<const loaded_asset>& asset, const material_binding& binding)
+    {
+        if (!asset) return nullptr;
+        shared_ptr<triangle_mesh> mesh = triangle_mesh::share(asset->geometry);
+        if (binding.registry)
+        {
+            obj_loader::assign_materials(*mesh, asset->names, asset->folder, *binding.registry, binding.fallback);
+        }
+        else
+        {
+            for (std::uint32_t slot = 0; slot < mesh->num_material_slots(); slot++) mesh->set_slot_material(slot, binding.fallback);
+        }
+        return mesh;
+    }
+};
+
+#endif //ASSET_MANAGER_H
@@ -0,0 +1,100 @@
+//
+// Created by Faye Yu on 1/11/26.
+//
+
+#ifndef BOX_H
+#define BOX_H
+
+#include "hittable.h"
+
+class box : public hittable
+{
+/*
+ * axis aligned box with corners a and b. one slab test finds the entry/exit face directly,
+ * instead of scanning a hittable_list of 6 quads. put it in a transform to rotate it
+ */
+public:
+    box(const point3& a, const point3& b, material_id mat) : mat(mat)
+    {
+        min = point3(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
+        max = point3(std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()), std::fmax(a.z(), b.z()));
+        bbox = aabb(min, max);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    {
+        const point3& origin = r.origin();
+        const vec3& direction = r.direction();
+
+        //the ray is inside every slab between t_enter and t_exit
+        real t_enter = -infinity;
+        real t_exit = infinity;
+        int enter_axis = 0;
+        int exit_axis = 0;
+        for (int axis = 0; axis < 3; axis++)
+        {
+            if (direction[axis] == 0)
+            {
+                //parallel to this slab, either always inside it or never
+                if (origin[axis] < min[axis] || origin[axis] > max[axis]) return false;
+                continue;
+            }
+            real inv_d = 1 / direction[axis];
+            real t0 = (min[axis] - origin[axis]) * inv_d;
+            real t1 = (max[axis] - origin[axis]) * inv_d;
+            if (t0 > t1) std::swap(t0, t1);
+            if (t0 > t_enter)
+            {
+                t_enter = t0;
+                enter_axis = axis;
+            }
+            if (t1 < t_exit)
+            {
+                t_exit = t1;
+                exit_axis = axis;
+            }
+            if (t_enter > t_exit) return false;
+        }
+
+        //first try the face we enter through, else the one we leave through (ray starts inside)
+        real t;
+        int axis;
+        bool entering = ray_t.surrounds(t_enter);
+        if (entering)
+        {
+            t = t_enter;
+            axis = enter_axis;
+        }
+        else if (ray_t.surrounds(t_exit))
+        {
+            t = t_exit;
+            axis = exit_axis;
+        }
+        else return false;
+
+        //the face we hit is the one facing against the ray on entry, and along it on exit
+        bool positive_face = entering ? direction[axis] < 0 : direction[axis] > 0;
+        vec3 outward_normal;
+        outward_normal[axis] = positive_face ? 1 : -1;
+
+        rec.t = t;
+        rec.p = r.at(t);
+        rec.p[axis] = positive_face ? max[axis] : min[axis]; //snap onto the face plane
+        rec.p_error = error_gamma(3) * abs(rec.p);
+        rec.set_face_normal(r, outward_normal);
+        rec.mat = mat;
+        rec.incident_eta = r.current_ior();
+        return true;
+    }
+    aabb bounding_box() const override { return bbox; }
+    point3 min_corner() const { return min; }
+    point3 max_corner() const { return max; }
+    material_id get_material() const { return mat; }
+private:
+    point3 min;
+    point3 max;
+    material_id mat;
+    aabb bbox;
+};
+
+#endif //BOX_H
@@ -0,0 +1,147 @@
+//
+// Created by Faye Yu on 1/22/26.
+//
+
+#ifndef BSDF_TABLE_H
+#define BSDF_TABLE_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "color.h"
+
+class bsdf_table
+{
+/*
+ * an isotropic reflection-only bsdf stored as numbers instead of formulas, f(roughness, cos_o, cos_i, phi) where phi is
+ * the azimuth between wo and wi folded into [0, pi]. roughness goes 0 -> 1 over the grid's end points, the other axes
+ * are bins with samples at their centers. lookups interpolate between the 16 nearest entries.
+ * also keeps each row's directional albedo and a cdf over its (cos_i, phi) bins for importance sampling
+ */
+public:
+    bsdf_table(int rough_size, int mu_size, int phi_size) :
+    rough_size(rough_size), mu_size(mu_size), phi_size(phi_size),
+    values(size_t(rough_size) * mu_size * mu_size * phi_size, color(0, 0, 0)),
+    albedos(size_t(rough_size) * mu_size, color(0, 0, 0)),
+    cdfs(size_t(rough_size) * mu_size * mu_size * phi_size, 0.0f) {}
+
+    int roughness_size() const { return rough_size; }
+    int cos_size() const { return mu_size; }
+    int azimuth_size() const { return phi_size; }
+
+    //grid coordinates
+    double roughness_at(int r) const { return rough_size == 1 ? 0 : double(r) / (rough_size - 1); }
+    double cos_at(int i) const { return (i + 0.5) / mu_size; }
+    double azimuth_at(int p) const { return (p + 0.5) * M_PI / phi_size; }
+    int cos_bin(double mu) const { return std::clamp(int(mu * mu_size), 0, mu_size - 1); }
+    int azimuth_bin(double phi) const { return std::clamp(int(phi / M_PI * phi_size), 0, phi_size - 1); }
+
+    color& at(int r, int o, int i, int p) { return values[index(r, o, i, p)]; }
+    const color& at(int r, int o, int i, int p) const { return values[index(r, o, i, p)]; }
+
+    //call once every entry is filled in, builds the albedos and cdfs
+    void finish()
+    {
+        double cell_phi = 2 * M_PI / phi_size; //each phi bin covers both signs of the azimuth
+        for (int r = 0; r < rough_size; r++)
+        {
+            for (int o = 0; o < mu_size; o++)
+            {
+                color albedo(0, 0, 0);
+                double total = 0;
+                for (int i = 0; i < mu_size; i++)
+                {
+                    //integral of cos over the bin's solid angle
+                    double lo = double(i) / mu_size, hi = double(i + 1) / mu_size;
+                    double projected = (hi * hi - lo * lo) / 2 * cell_phi;
+                    for (int p = 0; p < phi_size; p++)
+                    {
+                        albedo += at(r, o, i, p) * projected;
+                        total += std::max(0.0, luminance(at(r, o, i, p))) * projected;
+                        cdfs[index(r, o, i, p)] = float(total);
+                    }
+                }
+                albedos[size_t(r) * mu_size + o] = albedo;
+                float* row = &cdfs[index(r, o, 0, 0)];
+                for (int c = 0; c < mu_size * phi_size; c++) row[c] = total > 0 ? float(row[c] / total) : float(c + 1) / (mu_size * phi_size);
+            }
+        }
+    }
+
+    color evaluate(double roughness, double mu_o, double mu_i, double phi) const
+    {
+        double r = std::clamp(roughness, 0.0, 1.0) * (rough_size - 1);
+        double o = std::clamp(mu_o * mu_size - 0.5, 0.0, mu_size - 1.0);
+        double i = std::clamp(mu_i * mu_size - 0.5, 0.0, mu_size - 1.0);
+        double p = std::clamp(phi / M_PI * phi_size - 0.5, 0.0, phi_size - 1.0);
+        int r0 = std::min(int(r), std::max(0, rough_size - 2)), o0 = std::min(int(o), mu_size - 2);
+        int i0 = std::min(int(i), mu_size - 2), p0 = std::min(int(p), std::max(0, phi_size - 2));
+        double fr = r - r0, fo = o - o0, fi = i - i0, fp = p - p0;
+        int r1 = std::min(r0 + 1, rough_size - 1), p1 = std::min(p0 + 1, phi_size - 1);
+
+        color result(0, 0, 0);
+        for (int c = 0; c < 16; c++)
+        {
+            double w = ((c & 1) ? fr : 1 - fr) * ((c & 2) ? fo : 1 - fo) * ((c & 4) ? fi : 1 - fi) * ((c & 8) ? fp : 1 - fp);
+            if (w == 0) continue;
+            result += w * at((c & 1) ? r1 : r0, o0 + ((c >> 1) & 1), i0 + ((c >> 2) & 1), (c & 8) ? p1 : p0);
+        }
+        return result;
+    }
+    //fraction of the light arriving along mu_o that gets scattered back out
+    color albedo(double roughness, double mu_o) const
+    {
+        double r = std::clamp(roughness, 0.0, 1.0) * (rough_size - 1);
+        double o = std::clamp(mu_o * mu_size - 0.5, 0.0, mu_size - 1.0);
+        int r0 = std::min(int(r), std::max(0, rough_size - 2)), o0 = std::min(int(o), mu_size - 2);
+        int r1 = std::min(r0 + 1, rough_size - 1);
+        double fr = r - r0, fo = o - o0;
+        auto row = [&](int ri){ return albedos[size_t(ri) * mu_size + o0] * (1 - fo) + albedos[size_t(ri) * mu_size + o0 + 1] * fo; };
+        return row(r0) * (1 - fr) + row(r1) * fr;
+    }
+
+    /**
+     * Picks a (cos_i, phi) from the nearest row's bins, in proportion to the energy scattered into each
+     * @param u0 @param u1 @param u2 uniform in [0, 1)
+     * @return pdf per solid angle, phi comes back signed
+     */
+    double sample(double roughness, double mu_o, double u0, double u1, double u2, double& mu_i, double& phi) const
+    {
+        const float* row = &cdfs[row_index(roughness, mu_o)];
+        int cells = mu_size * phi_size;
+        int c = int(std::upper_bound(row, row + cells, float(u0)) - row);
+        c = std::min(c, cells - 1);
+        int i = c / phi_size, p = c % phi_size;
+        mu_i = (i + u1) / mu_size;
+        //half of u2 picks the side of wo, the rest places phi in the bin
+        bool negative = u2 >= 0.5;
+        double azimuth = (p + (negative ? 2 * u2 - 1 : 2 * u2)) * M_PI / phi_size;
+        phi = negative ? -azimuth : azimuth;
+        return cell_pdf(row, c);
+    }
+    double pdf(double roughness, double mu_o, double mu_i, double phi) const
+    {
+        const float* row = &cdfs[row_index(roughness, mu_o)];
+        return cell_pdf(row, cos_bin(mu_i) * phi_size + azimuth_bin(std::abs(phi)));
+    }
+private:
+    int rough_size, mu_size, phi_size;
+    std::vector<color> values; //[roughness][cos_o][cos_i][phi]
+    std::vector<color> albedos; //[roughness][cos_o]
+    std::vector<float> cdfs; //[roughness][cos_o][cos_i * phi], running sums over a row
+
+    size_t index(int r, int o, int i, int p) const { return ((size_t(r) * mu_size + o) * mu_size + i) * phi_size + p; }
+    size_t row_index(double roughness, double mu_o) const
+    {
+        int r = std::clamp(int(std::lround(std::clamp(roughness, 0.0, 1.0) * (rough_size - 1))), 0, rough_size - 1);
+        return index(r, cos_bin(mu_o), 0, 0);
+    }
+    //probability of the cell over its solid angle
+    double cell_pdf(const float* row, int c) const
+    {
+        double p = row[c] - (c > 0 ? row[c - 1] : 0.0f);
+        return p / ((1.0 / mu_size) * (2 * M_PI / phi_size));
+    }
+};
+
+#endif //BSDF_TABLE_H
@@ -49,20 +49,21 @@ class bvh_node : public hittable
             //Split the list: if the size of list is < 12, split into that number of buckets
             //Otherwise split into 12 buckets
             int num_buckets = (object_span) < 12 ? static_cast<int>(object_span) : 12;
-            size_t optimal_partition = sah_partition(objects, start, end, axis, num_buckets, bbox.axis_interval(axis).size() / num_buckets);
+            size_t optimal_partition = sah_partition(objects, start, end, axis, num_buckets, bbox.axis_interval(axis).min,
+                                                     bbox.axis_interval(axis).size() / num_buckets);
             left = make_shared<bvh_node>(objects, start, optimal_partition+1);
             right = make_shared<bvh_node>(objects, optimal_partition+1, end);
         }
     }
-    size_t sah_partition(const std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, int axis, int num_buckets, double bucket_length) const
+    size_t sah_partition(const std::vector<shared_ptr<hittable>>& objects, size_t start, size_t end, int axis, int num_buckets, real axis_min, real bucket_length) const
     {
         size_t best_index = start;
         size_t current_index = start;
         aabb left = objects[current_index]->bounding_box();
-        double min_sa = infinity;
+        real min_sa = infinity;
         for (int i = 1; i <= num_buckets; i++) //for loop through each bucket
         {
-            double bound = bucket_length*i;
+            real bound = axis_min + bucket_length*i; //buckets start at the node bbox, not at 0
             //loop through bounding boxes, adding them to left box until we'd go into another bucket
             while (current_index < end && objects[current_index]->bounding_box().get_centroid()[axis] <= bound)
             {
@@ -71,7 +72,7 @@ class bvh_node : public hittable
             }
             if (current_index == end) break;
 
-            double left_sa = left.surface_area(); //calc the surface area of left and right, sum them, save index
+            real left_sa = left.surface_area(); //calc the surface area of left and right, sum them, save index
             if (left_sa > min_sa) continue; //little optimization: if the left box SA is > the min SA sum already, don't calc the right one
 
             aabb right = aabb::empty;
@@ -80,7 +81,7 @@ class bvh_node : public hittable
             {
                 right = aabb(right, objects[j]->bounding_box());
             }
-            double right_sa = right.surface_area();
+            real right_sa = right.surface_area();
             if (left_sa + right_sa < min_sa) //at the end of loop: the partition w the minimum SA is what we choose
             {
                 best_index = current_index == start ? start : current_index-1;
@@ -102,6 +103,8 @@ class bvh_node : public hittable
         return hit_left || hit_right;
     }
     aabb bounding_box() const override {return bbox;};
+    const shared_ptr<hittable>& left_child() const { return left; }
+    const shared_ptr<hittable>& right_child() const { return right; }
 private:
     shared_ptr<hittable> left;
     shared_ptr<hittable> right;
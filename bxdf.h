@@ -4,7 +4,15 @@
 
 #ifndef BXDF_H
 #define BXDF_H
+#include <new>
+#include <span>
+#include <type_traits>
+#include <variant>
 #include "fresnel.h"
+#include "frame.h"
+#include "microfacet.h"
+#include "bsdf_table.h"
+#include "memory_arena.h"
 
 enum bxdf_flags
 {
@@ -42,6 +50,11 @@ inline bool is_specular(bxdf_flags f)
 {
     return f & Specular;
 }
+//has a lobe that light sampling can hit, delta lobes only ever see their own direction
+inline bool is_non_specular(bxdf_flags f)
+{
+    return f & (Diffuse | Glossy);
+}
 
 class bsdf_sample{
 public:
@@ -54,33 +67,24 @@ public:
     wi(wi), f(f), pdf(pdf), is_delta(is_delta){};
 };
 
+//the parts every lobe has, lobes are plain types held in a bxdf_lobe (no virtual calls)
 class bxdf
 {
 public:
     bxdf_flags flags = Unset;
     double magnitude = 1.0;
 
-    virtual ~bxdf() = default;
-
     vec3 n = vec3(0, 0, 1);
     vec3 s = vec3(1, 0, 0);
     vec3 t = vec3(0, 1, 0);
 
-    //all these methods assume the vectors are already in the bxdf coordinate system
-    //assume that vectors passed into the bxdf methods are alr in this coord sys
-    virtual color f_s(const vec3& wo, const vec3& wi) const
-    {
-        return color(0,0,0);
-    }
-    virtual double pdf(const vec3& wo, const vec3& wi) const
-    {
-        return 0.0;
-    }
-    virtual bsdf_sample sample(const vec3& wo) const
-    {
-        return bsdf_sample();
-    }
-    std::string flags_to_string()
+    //every lobe has these, and they all take vectors already in the bxdf coordinate system:
+    //color f_s(const vec3& wo, const vec3& wi) const
+    //double pdf(const vec3& wo, const vec3& wi) const
+    //bsdf_sample sample(const vec3& wo) const
+    //color albedo(const vec3& wo) const -- roughly how much of the light arriving along wo the lobe scatters
+    //(reflected + transmitted), bsdf picks lobes in proportion to it. a lobe without a closed form can read it from a table
+    std::string flags_to_string() const
     {
         std::string s;
         if (is_reflective(flags))
@@ -108,19 +112,20 @@ public:
 class lambertian_reflection : public bxdf
 {
 public:
-    lambertian_reflection(const color& albedo) : albedo(albedo)
+    lambertian_reflection() : lambertian_reflection(color(0, 0, 0)) {}
+    lambertian_reflection(const color& albedo) : diffuse_color(albedo)
     {
         flags = DiffuseReflection;
     }
-    color f_s(const vec3& wo, const vec3& wi) const override
+    color f_s(const vec3& wo, const vec3& wi) const
     {
         if (dot(n, wi) <= 0.0)
         {
             return color(0,0,0); //incoming ray is below the surface
         }
-        return albedo / M_PI;
+        return diffuse_color / M_PI;
     }
-    double pdf(const vec3& wo, const vec3& wi) const override
+    double pdf(const vec3& wo, const vec3& wi) const
     {
         double cos_theta = dot(n, wi);
         if (cos_theta <= 0.0)
@@ -129,116 +134,572 @@ public:
         }
         return cos_theta / M_PI;
     }
-    bsdf_sample sample(const vec3& wo) const override
+    template <typename Rand = double (*)()>
+    bsdf_sample sample(const vec3& wo, Rand rand = random_double) const
     {
         //generate a wi using cosine weighted hemisphere sampling
-        vec3 wi = cos_weighted_random_in_hemisphere();
+        vec3 wi = cos_weighted_random_in_hemisphere(rand(), rand());
 
         //populate a bxdf_sample with calculated wi, f, pdf, is_delta
         return bsdf_sample(wi, f_s(wo, wi), pdf(wo, wi), false);
     }
+    color albedo(const vec3& wo) const
+    {
+        return diffuse_color;
+    }
 private:
-    color albedo;
+    color diffuse_color;
 };
 
-class specular_reflection : bxdf
+//mirror reflection tinted by specular_color. fuzz > 0 jitters the mirror direction like metal::scatter does
+class specular_reflection : public bxdf
 {
 public:
-    specular_reflection(const color& specular_color, fresnel *f) : specular_color(specular_color), f(f)
+    specular_reflection(const color& specular_color, double fuzz = 0) : specular_color(specular_color), fuzz(fuzz)
     {
         flags = SpecularReflection;
     }
+    color f_s(const vec3& wo, const vec3& wi) const
+    {
+        return color(0,0,0); //only the sampled direction gets any light
+    }
+    double pdf(const vec3& wo, const vec3& wi) const
+    {
+        return 0.0;
+    }
+    template <typename Rand = double (*)()>
+    bsdf_sample sample(const vec3& wo, Rand rand = random_double) const
+    {
+        vec3 wi = vec3(-wo.x(), -wo.y(), wo.z());
+        if (fuzz > 0) wi = unit_vector(wi + fuzz * random_unit_vector(rand));
+        if (wi.z() <= 0) return bsdf_sample(); //fuzzed into the surface, absorbed
+        //f * cos / pdf comes out as specular_color
+        return bsdf_sample(wi, specular_color / std::abs(wi.z()), 1, true);
+    }
+    color albedo(const vec3& wo) const
+    {
+        return specular_color;
+    }
 private:
     color specular_color;
-    fresnel *f; //ask chat what * means
+    double fuzz;
 };
 
-class bsdf
+//smooth dielectric boundary (ex: glass): reflects with probability F and refracts otherwise (pbrt 9.5)
+class fresnel_specular : public bxdf
 {
 public:
-    std::vector<std::unique_ptr<bxdf>> bxdfs;
-    const hit_record& rec;
+    //eta_i on the side wo is on, eta_t on the other
+    fresnel_specular(double eta_i, double eta_t) : eta_i(eta_i), eta_t(eta_t)
+    {
+        flags = bxdf_flags(Reflection | Transmission | Specular);
+    }
+    color f_s(const vec3& wo, const vec3& wi) const
+    {
+        return color(0,0,0);
+    }
+    double pdf(const vec3& wo, const vec3& wi) const
+    {
+        return 0.0;
+    }
+    template <typename Rand = double (*)()>
+    bsdf_sample sample(const vec3& wo, Rand rand = random_double) const
+    {
+        double cos_theta = std::abs(wo.z());
+        double reflectance = fresnel_dielectric::reflectance(cos_theta, eta_i, eta_t);
+        if (rand() < reflectance)
+        {
+            vec3 wi = vec3(-wo.x(), -wo.y(), wo.z());
+            return bsdf_sample(wi, color(1, 1, 1) * (reflectance / cos_theta), reflectance, true);
+        }
+        vec3 wi = refract(-unit_vector(wo), n, eta_i / eta_t);
+        //radiance is compressed into a smaller solid angle going into the denser side
+        double transmittance = (1 - reflectance) * (eta_i * eta_i) / (eta_t * eta_t);
+        return bsdf_sample(wi, color(1, 1, 1) * (transmittance / std::abs(wi.z())), 1 - reflectance, true);
+    }
+    color albedo(const vec3& wo) const
+    {
+        return color(1, 1, 1); //nothing is absorbed, it all either reflects or refracts
+    }
+private:
+    double eta_i, eta_t;
+};
 
-    bsdf(const hit_record& rec) : rec(rec) {};
+/*
+ * rough metal: ggx microfacets with the complex fresnel of a conductor. eta and k are relative to the outside.
+ * below alpha ~1e-3 it turns into a perfect mirror (a delta lobe)
+ */
+class microfacet_conductor : public bxdf
+{
+public:
+    microfacet_conductor(const trowbridge_reitz& distrib, const color& eta, const color& k) :
+    distrib(distrib), eta(eta), k(k)
+    {
+        flags = distrib.effectively_smooth() ? SpecularReflection : GlossyReflection;
+    }
+    color f_s(const vec3& wo, const vec3& wi) const
+    {
+        if (!same_hemisphere(wo, wi) || distrib.effectively_smooth()) return color(0, 0, 0);
+        double cos_o = std::abs(cos_theta(wo)), cos_i = std::abs(cos_theta(wi));
+        vec3 wm = wi + wo;
+        if (cos_i == 0 || cos_o == 0 || wm.length_squared() == 0) return color(0, 0, 0);
+        wm = unit_vector(wm);
+        color F = fresnel_conductor::reflectance(std::abs(dot(wo, wm)), eta, k);
+        return distrib.D(wm) * distrib.G(wo, wi) / (4 * cos_i * cos_o) * F * multiple_scattering(wo);
+    }
+    double pdf(const vec3& wo, const vec3& wi) const
+    {
+        if (!same_hemisphere(wo, wi) || distrib.effectively_smooth()) return 0;
+        vec3 wm = wo + wi;
+        if (wm.length_squared() == 0) return 0;
+        wm = unit_vector(wm);
+        if (wm.z() < 0) wm = -wm;
+        //visible normal pdf, times the jacobian of reflecting about wm
+        return distrib.pdf(wo, wm) / (4 * std::abs(dot(wo, wm)));
+    }
+    template <typename Rand = double (*)()>
+    bsdf_sample sample(const vec3& wo, Rand rand = random_double) const
+    {
+        if (distrib.effectively_smooth())
+        {
+            vec3 wi = vec3(-wo.x(), -wo.y(), wo.z());
+            double cos_i = std::abs(wi.z());
+            return bsdf_sample(wi, fresnel_conductor::reflectance(cos_i, eta, k) / cos_i, 1, true);
+        }
+        if (wo.z() == 0) return bsdf_sample();
+        vec3 wm = distrib.sample_wm(wo, rand(), rand());
+        vec3 wi = reflect(-wo, wm);
+        if (!same_hemisphere(wo, wi)) return bsdf_sample(); //reflected into the surface, shadowed
+        return bsdf_sample(wi, f_s(wo, wi), distrib.pdf(wo, wm) / (4 * std::abs(dot(wo, wm))), false);
+    }
+    color albedo(const vec3& wo) const
+    {
+        return fresnel_conductor::reflectance(std::abs(cos_theta(wo)), eta, k);
+    }
+private:
+    trowbridge_reitz distrib;
+    color eta, k;
 
-    template <typename T, typename... Args>
-    void add(Args&&... args)
+    //puts back the light lost between microfacets, tinted by the fresnel at normal incidence (Turquin 2019)
+    color multiple_scattering(const vec3& wo) const
+    {
+        double E = std::max(microfacet_albedo::conductor(cos_theta(wo), distrib.alpha()), 0.05);
+        color F0 = fresnel_conductor::reflectance(1, eta, k);
+        return color(1, 1, 1) + F0 * ((1 - E) / E);
+    }
+};
+
+/*
+ * rough glass: ggx microfacets that reflect or refract by the dielectric fresnel, pbrt-v4 9.7.
+ * eta is the ior on the -z side over the ior on the +z side. smooth glass should use fresnel_specular
+ */
+class microfacet_dielectric : public bxdf
+{
+public:
+    microfacet_dielectric(const trowbridge_reitz& distrib, double eta) : distrib(distrib), eta(eta)
     {
-        bxdfs.push_back(std::make_unique<T>(std::forward<Args>(args)...));
+        flags = bxdf_flags(Reflection | Transmission | Glossy);
     }
-    //the physically correct f_s from each bxdf
     color f_s(const vec3& wo, const vec3& wi) const
     {
-        //NOTE TO SELF: might have a problem with reflection/transmission if u need to filter out certain non-delta lobes
-        //or if its in the wrong hemisphere or smth
-        color result = color(0, 0, 0);
-        for (const auto & bxdf : bxdfs)
+        double cos_o = cos_theta(wo), cos_i = cos_theta(wi);
+        bool reflect = cos_i * cos_o > 0;
+        double etap = reflect ? 1 : (cos_o > 0 ? eta : 1 / eta);
+        vec3 wm;
+        if (!half_vector(wo, wi, etap, wm)) return color(0, 0, 0);
+
+        double F = fresnel_dielectric::reflectance(dot(wo, wm), 1, eta);
+        double value;
+        if (reflect)
         {
-            result+=bxdf->f_s(wo, wi); //if is delta, this will be 0 so issok
+            value = distrib.D(wm) * distrib.G(wo, wi) * F / std::abs(4 * cos_i * cos_o);
         }
-        return result;
+        else
+        {
+            double denom = dot(wi, wm) + dot(wo, wm) / etap;
+            denom = denom * denom * cos_i * cos_o;
+            value = distrib.D(wm) * (1 - F) * distrib.G(wo, wi) * std::abs(dot(wi, wm) * dot(wo, wm) / denom);
+            value /= etap * etap; //radiance squeezes into a smaller solid angle going into the denser side
+        }
+        return color(1, 1, 1) * (value / multiple_scattering(wo));
     }
-    //the marginal pdf for wi, equal to sum(i = 1 -> k) Pr(choosing kth lobe) * Pr(getting wi from the kth lobe)
     double pdf(const vec3& wo, const vec3& wi) const
     {
-        double w_k = 1.0/static_cast<double>(bxdfs.size()); //TODO change to not be uniform later
-        double result = 0.0;
-        for (const auto & bxdf : bxdfs)
+        double cos_o = cos_theta(wo), cos_i = cos_theta(wi);
+        bool reflect = cos_i * cos_o > 0;
+        double etap = reflect ? 1 : (cos_o > 0 ? eta : 1 / eta);
+        vec3 wm;
+        if (!half_vector(wo, wi, etap, wm)) return 0;
+
+        double R = fresnel_dielectric::reflectance(dot(wo, wm), 1, eta);
+        if (reflect) return distrib.pdf(wo, wm) / (4 * std::abs(dot(wo, wm))) * R;
+        double denom = dot(wi, wm) + dot(wo, wm) / etap;
+        double dwm_dwi = std::abs(dot(wi, wm)) / (denom * denom);
+        return distrib.pdf(wo, wm) * dwm_dwi * (1 - R);
+    }
+    template <typename Rand = double (*)()>
+    bsdf_sample sample(const vec3& wo, Rand rand = random_double) const
+    {
+        if (wo.z() == 0) return bsdf_sample();
+        vec3 wm = distrib.sample_wm(wo, rand(), rand());
+        double R = fresnel_dielectric::reflectance(dot(wo, wm), 1, eta);
+        vec3 wi;
+        if (rand() < R)
         {
-            result+=w_k * bxdf->pdf(wo, wi); //if is delta, this will be 0 so issok
+            wi = reflect(-wo, wm);
+            if (!same_hemisphere(wo, wi)) return bsdf_sample();
         }
-        return result;
+        else
+        {
+            double etap;
+            if (!refract_about(wo, wm, eta, etap, wi) || same_hemisphere(wo, wi) || wi.z() == 0) return bsdf_sample();
+        }
+        double p = pdf(wo, wi);
+        if (p == 0) return bsdf_sample();
+        return bsdf_sample(wi, f_s(wo, wi), p, false);
     }
-    //wo is in world space
-    bsdf_sample sample(const vec3& wo_world) const
+    color albedo(const vec3& wo) const
     {
-        //TODO i will use uniform for now and then switch to balance heuristic or whatever later so i can compare
-        int rand_ind = random_int(0,static_cast<int>(bxdfs.size()) - 1);
-        const bxdf& b = *bxdfs[rand_ind];
-        vec3 wo = local_to_render(wo_world);
-        bsdf_sample sample_for_dir = b.sample(wo);
-        vec3 wi = sample_for_dir.wi;
-        if (sample_for_dir.is_delta)
+        return color(1, 1, 1); //nothing is absorbed, it all either reflects or refracts
+    }
+private:
+    trowbridge_reitz distrib;
+    double eta;
+
+    //the microfacet normal that takes wo to wi, facing +z. false if wo or wi would be behind it
+    static bool half_vector(const vec3& wo, const vec3& wi, double etap, vec3& wm)
+    {
+        double cos_o = cos_theta(wo), cos_i = cos_theta(wi);
+        wm = wi * etap + wo;
+        if (cos_i == 0 || cos_o == 0 || wm.length_squared() == 0) return false;
+        wm = unit_vector(wm);
+        if (wm.z() < 0) wm = -wm;
+        return dot(wm, wi) * cos_i >= 0 && dot(wm, wo) * cos_o >= 0;
+    }
+    //refracts wi through a facet with normal n, eta being the ior on n's back side over its front side. etap is the ratio used
+    static bool refract_about(const vec3& wi, vec3 n, double eta, double& etap, vec3& wt)
+    {
+        double cos_i = dot(n, wi);
+        if (cos_i < 0)
+        {
+            //wi is on the back side
+            eta = 1 / eta;
+            cos_i = -cos_i;
+            n = -n;
+        }
+        double sin2_t = std::max(0.0, 1 - cos_i * cos_i) / (eta * eta);
+        if (sin2_t >= 1) return false; //total internal reflection
+        double cos_t = std::sqrt(1 - sin2_t);
+        wt = -wi / eta + (cos_i / eta - cos_t) * n;
+        etap = eta;
+        return true;
+    }
+    //divides out the light lost between microfacets, so a non-absorbing rough boundary lets everything through (Turquin 2019)
+    double multiple_scattering(const vec3& wo) const
+    {
+        double etap = cos_theta(wo) > 0 ? eta : 1 / eta;
+        return std::max(microfacet_albedo::dielectric(cos_theta(wo), distrib.alpha(), etap), 0.05);
+    }
+};
+
+/*
+ * just the reflection off a dielectric boundary (ex: a clear coat), whatever refracts in is left for the lobes under it.
+ * smooth below alpha ~1e-3, otherwise ggx. eta is the ior under the boundary over the ior above it
+ */
+class dielectric_reflection : public bxdf
+{
+public:
+    dielectric_reflection(const trowbridge_reitz& distrib, double eta) : distrib(distrib), eta(eta)
+    {
+        flags = distrib.effectively_smooth() ? SpecularReflection : GlossyReflection;
+    }
+    color f_s(const vec3& wo, const vec3& wi) const
+    {
+        if (!same_hemisphere(wo, wi) || distrib.effectively_smooth()) return color(0, 0, 0);
+        double cos_o = std::abs(cos_theta(wo)), cos_i = std::abs(cos_theta(wi));
+        vec3 wm = wi + wo;
+        if (cos_i == 0 || cos_o == 0 || wm.length_squared() == 0) return color(0, 0, 0);
+        wm = unit_vector(wm);
+        double F = fresnel_dielectric::reflectance(std::abs(dot(wo, wm)), 1, eta);
+        double E = std::max(microfacet_albedo::dielectric(cos_o, distrib.alpha(), eta), 0.05);
+        return color(1, 1, 1) * (distrib.D(wm) * distrib.G(wo, wi) * F / (4 * cos_i * cos_o * E));
+    }
+    double pdf(const vec3& wo, const vec3& wi) const
+    {
+        if (!same_hemisphere(wo, wi) || distrib.effectively_smooth()) return 0;
+        vec3 wm = wo + wi;
+        if (wm.length_squared() == 0) return 0;
+        wm = unit_vector(wm);
+        if (wm.z() < 0) wm = -wm;
+        return distrib.pdf(wo, wm) / (4 * std::abs(dot(wo, wm)));
+    }
+    template <typename Rand = double (*)()>
+    bsdf_sample sample(const vec3& wo, Rand rand = random_double) const
+    {
+        if (distrib.effectively_smooth())
         {
-            return sample_for_dir; //if it's a delta distribution don't add up any other bxdfs into f and pdf
+            vec3 wi = vec3(-wo.x(), -wo.y(), wo.z());
+            double cos_i = std::abs(wi.z());
+            return bsdf_sample(wi, color(1, 1, 1) * (fresnel_dielectric::reflectance(cos_i, 1, eta) / cos_i), 1, true);
         }
-        vec3 wi_world = render_to_local(wi);
-        return bsdf_sample(wi_world, f_s(wo, wi), pdf(wo, wi), false);
+        if (wo.z() == 0) return bsdf_sample();
+        vec3 wm = distrib.sample_wm(wo, rand(), rand());
+        vec3 wi = reflect(-wo, wm);
+        if (!same_hemisphere(wo, wi)) return bsdf_sample();
+        return bsdf_sample(wi, f_s(wo, wi), distrib.pdf(wo, wm) / (4 * std::abs(dot(wo, wm))), false);
     }
-    vec3 local_to_render(const vec3& v_local) const
+    color albedo(const vec3& wo) const
     {
-        //create an orthonormal basis at the hit_record point, with up = normal
-        const vec3& n = rec.normal;
-        vec3 a = (std::abs(rec.normal.x()) > 0.95) ? vec3(0, 1, 0) : vec3(1, 0, 0);
-        //a is just any vector that's not parallel to normal
-        vec3 t1 = unit_vector(cross(a, n));
-        vec3 t2 = cross(n, t1);
+        double F = fresnel_dielectric::reflectance(std::abs(cos_theta(wo)), 1, eta);
+        return color(F, F, F);
+    }
+private:
+    trowbridge_reitz distrib;
+    double eta;
+};
 
-        //we want to multiply v_local by the inverse of [t1 | t2 | n]
-        //bc its an orthonormal basis the inverse is just the transpose so now t1, t2, n are the rows
-        return vec3(dot(v_local, t1), dot(v_local, t2), dot(v_local, n));
+/*
+ * a reflection lobe read out of a bsdf_table at one roughness (ex: the light that gets through a coat and back out).
+ * samples the table's bins, mixed with some cosine sampling so directions between bins with light are never missed
+ */
+class tabulated_reflection : public bxdf
+{
+public:
+    tabulated_reflection(const bsdf_table* table, double roughness) : table(table), roughness(roughness)
+    {
+        flags = table->azimuth_size() > 1 ? GlossyReflection : DiffuseReflection;
+    }
+    color f_s(const vec3& wo, const vec3& wi) const
+    {
+        if (wo.z() <= 0 || wi.z() <= 0) return color(0, 0, 0);
+        return table->evaluate(roughness, wo.z(), wi.z(), std::abs(relative_azimuth(wo, wi)));
+    }
+    double pdf(const vec3& wo, const vec3& wi) const
+    {
+        if (wo.z() <= 0 || wi.z() <= 0) return 0;
+        double from_table = table->pdf(roughness, wo.z(), wi.z(), relative_azimuth(wo, wi));
+        return (1 - cosine_fraction) * from_table + cosine_fraction * wi.z() / M_PI;
     }
-    vec3 render_to_local(const vec3& v_render) const
+    template <typename Rand = double (*)()>
+    bsdf_sample sample(const vec3& wo, Rand rand = random_double) const
     {
-        //convert to world space by creating an orthonormal basis at the hit_record point, with up = normal
-        const vec3& n = rec.normal;
-        vec3 a = (std::abs(rec.normal.x()) > 0.95) ? vec3(0, 1, 0) : vec3(1, 0, 0);
-        //a is just any vector that's not parallel to normal
-        vec3 t1 = unit_vector(cross(a, n));
-        vec3 t2 = cross(n, t1);
+        if (wo.z() <= 0) return bsdf_sample();
+        vec3 wi;
+        if (rand() < cosine_fraction)
+        {
+            wi = cos_weighted_random_in_hemisphere(rand(), rand());
+        }
+        else
+        {
+            double mu_i, phi;
+            table->sample(roughness, wo.z(), rand(), rand(), rand(), mu_i, phi);
+            phi += std::atan2(wo.y(), wo.x());
+            double sin_i = std::sqrt(std::max(0.0, 1 - mu_i * mu_i));
+            wi = vec3(sin_i * std::cos(phi), sin_i * std::sin(phi), mu_i);
+        }
+        double p = pdf(wo, wi);
+        if (p == 0) return bsdf_sample();
+        return bsdf_sample(wi, f_s(wo, wi), p, false);
+    }
+    color albedo(const vec3& wo) const
+    {
+        return table->albedo(roughness, std::abs(wo.z()));
+    }
+private:
+    static constexpr double cosine_fraction = 0.25;
+    const bsdf_table* table; //owned by the material
+    double roughness;
 
-        return v_render.x() * t1 + v_render.y() * t2 + v_render.z() * n;
+    //azimuth of wi around the normal, measured from wo's, in [-pi, pi]
+    static double relative_azimuth(const vec3& wo, const vec3& wi)
+    {
+        double phi = std::atan2(wi.y(), wi.x()) - std::atan2(wo.y(), wo.x());
+        if (phi > M_PI) phi -= 2 * M_PI;
+        if (phi < -M_PI) phi += 2 * M_PI;
+        return phi;
+    }
+};
+
+//every kind of lobe. a closed set so bsdf can hold lobes by value and dispatch with a switch
+//every lobe's sample(wo, rand) takes its random numbers from rand() (random_double by default),
+//so code sampling outside a render (ex: layered_table's precompute) can give it a generator of its own
+using bxdf_lobe = std::variant<lambertian_reflection, specular_reflection, fresnel_specular,
+                               microfacet_conductor, microfacet_dielectric, dielectric_reflection, tabulated_reflection>;
+//lobes are never destroyed, they live in a memory_arena
+static_assert(std::is_trivially_destructible_v<bxdf_lobe>);
+
+/*
+ * calls fn with the lobe as its own type. a plain switch on the index, so fn gets inlined for every lobe
+ * (std::visit can go through a table of function pointers, depending on the standard library)
+ */
+template <typename Fn>
+decltype(auto) visit_lobe(const bxdf_lobe& lobe, Fn&& fn)
+{
+    static_assert(std::variant_size_v<bxdf_lobe> == 7, "add a case for the new lobe");
+    switch (lobe.index())
+    {
+        case 1: return fn(*std::get_if<1>(&lobe));
+        case 2: return fn(*std::get_if<2>(&lobe));
+        case 3: return fn(*std::get_if<3>(&lobe));
+        case 4: return fn(*std::get_if<4>(&lobe));
+        case 5: return fn(*std::get_if<5>(&lobe));
+        case 6: return fn(*std::get_if<6>(&lobe));
+        default: return fn(*std::get_if<0>(&lobe));
+    }
+}
+
+class bsdf
+{
+/*
+ * a bsdf is made at every path vertex and thrown away right after, so it never touches the heap:
+ * its lobes sit in a fixed size array taken from the caller's per thread arena (reset after every sample)
+ */
+public:
+    static constexpr int max_bxdfs = 8;
+
+    bxdf_lobe* bxdfs;
+    int num_bxdfs = 0;
+    const hit_record& rec;
+    //built once here from the shading normal, every conversion at this vertex goes through it
+    frame shading;
+
+    bsdf(const hit_record& rec, memory_arena& arena) :
+    bxdfs(static_cast<bxdf_lobe*>(arena.allocate(max_bxdfs * sizeof(bxdf_lobe), alignof(bxdf_lobe)))), rec(rec),
+    shading(frame::from_z(rec.shading_normal)) {};
+
+    template <typename T, typename... Args>
+    void add(Args&&... args)
+    {
+        if (num_bxdfs == max_bxdfs)
+        {
+            std::clog << "bsdf already has " << max_bxdfs << " lobes, ignoring another" << std::endl;
+            return;
+        }
+        new (&bxdfs[num_bxdfs++]) bxdf_lobe(std::in_place_type<T>, std::forward<Args>(args)...);
+    }
+    std::span<const bxdf_lobe> lobes() const { return std::span<const bxdf_lobe>(bxdfs, num_bxdfs); }
+    //every lobe's flags together
+    bxdf_flags flags() const
+    {
+        int f = Unset;
+        for (const bxdf_lobe& lobe : lobes()) f |= visit_lobe(lobe, [](const auto& b){ return b.flags; });
+        return bxdf_flags(f);
+    }
+
+    vec3 to_local(const vec3& v) const { return shading.to_local(v); }
+    vec3 from_local(const vec3& v) const { return shading.from_local(v); }
+    //|cos| between a world space direction and the shading normal
+    double abs_cos_theta(const vec3& w) const { return std::abs(dot(w, shading.n)); }
+
+    //the physically correct f_s from each bxdf, wo and wi are in world space
+    color f_s(const vec3& wo_world, const vec3& wi_world) const
+    {
+        return f_s(to_local(unit_vector(wo_world)), to_local(wi_world), reflects(wo_world, wi_world));
+    }
+    //the marginal pdf for wi, equal to sum(i = 1 -> k) Pr(choosing kth lobe) * Pr(getting wi from the kth lobe)
+    double pdf(const vec3& wo_world, const vec3& wi_world) const
+    {
+        return pdf(to_local(unit_vector(wo_world)), to_local(wi_world), reflects(wo_world, wi_world));
+    }
+    //wo is in world space
+    bsdf_sample sample(const vec3& wo_world) const
+    {
+        if (num_bxdfs == 0) return bsdf_sample();
+        vec3 wo = to_local(unit_vector(wo_world));
+        double weights[max_bxdfs];
+        lobe_weights(wo, weights);
+
+        //pick a lobe in proportion to how much light it scatters, so dim lobes don't get as many samples as bright ones
+        int chosen = num_bxdfs - 1;
+        double u = random_double();
+        for (int i = 0; i < num_bxdfs - 1; i++)
+        {
+            if (u < weights[i])
+            {
+                chosen = i;
+                break;
+            }
+            u -= weights[i];
+        }
+        bsdf_sample sample_for_dir = visit_lobe(bxdfs[chosen], [&](const auto& b){ return b.sample(wo); });
+        vec3 wi = sample_for_dir.wi;
+        sample_for_dir.wi = from_local(wi);
+        if (sample_for_dir.is_delta || sample_for_dir.pdf == 0)
+        {
+            //if it's a delta distribution don't add up any other bxdfs into f and pdf,
+            //but the path only got here if this lobe was picked
+            sample_for_dir.pdf *= weights[chosen];
+            return sample_for_dir;
+        }
+        bool reflect = reflects(wo_world, sample_for_dir.wi);
+        return bsdf_sample(sample_for_dir.wi, f_s(wo, wi, reflect), pdf(wo, wi, reflect), false);
     }
     std::string flags_to_string()
     {
         std::string s;
-        for (auto & bxdf : bxdfs)
+        for (const bxdf_lobe& lobe : lobes())
         {
-            s+=bxdf->flags_to_string();
+            s+=visit_lobe(lobe, [](const auto& b){ return b.flags_to_string(); });
             s+="\n";
         }
         return s;
     }
+private:
+    /*
+     * whether wo and wi are on the same side of the actual surface. with an interpolated shading normal
+     * the two frames disagree near silhouettes, so the geometric normal decides which lobes can contribute
+     * (a reflection lobe can't light wi through the surface and vice versa, pbrt 9.1)
+     */
+    bool reflects(const vec3& wo_world, const vec3& wi_world) const
+    {
+        return dot(wo_world, rec.normal) * dot(wi_world, rec.normal) > 0;
+    }
+    static bool contributes(const bxdf& b, bool reflect)
+    {
+        return reflect ? is_reflective(b.flags) : is_transmission(b.flags);
+    }
+    //local space versions, wo and wi already went through the frame
+    color f_s(const vec3& wo, const vec3& wi, bool reflect) const
+    {
+        color result = color(0, 0, 0);
+        for (const bxdf_lobe& lobe : lobes())
+        {
+            //if is delta, this will be 0 so issok
+            result+=visit_lobe(lobe, [&](const auto& b){ return contributes(b, reflect) ? b.f_s(wo, wi) : color(0, 0, 0); });
+        }
+        return result;
+    }
+    //w_k is the chance sample() picks the kth lobe
+    double pdf(const vec3& wo, const vec3& wi, bool reflect) const
+    {
+        double weights[max_bxdfs];
+        lobe_weights(wo, weights);
+        double result = 0.0;
+        for (int k = 0; k < num_bxdfs; k++)
+        {
+            result+=weights[k] * visit_lobe(bxdfs[k], [&](const auto& b){ return contributes(b, reflect) ? b.pdf(wo, wi) : 0.0; });
+        }
+        return result;
+    }
+    //probability of picking each lobe for this wo, proportional to its albedo. falls back to uniform if they're all black
+    void lobe_weights(const vec3& wo, double* weights) const
+    {
+        if (num_bxdfs == 1)
+        {
+            weights[0] = 1;
+            return;
+        }
+        double total = 0;
+        for (int k = 0; k < num_bxdfs; k++)
+        {
+            weights[k] = std::max(0.0, luminance(visit_lobe(bxdfs[k], [&](const auto& b){ return b.albedo(wo); })));
+            total += weights[k];
+        }
+        for (int k = 0; k < num_bxdfs; k++)
+        {
+            weights[k] = total > 0 ? weights[k] / total : 1.0 / num_bxdfs;
+        }
+    }
 };
 
 #endif //BXDF_H
@@ -8,9 +8,12 @@
 #include "color.h"
 #include "hittable.h"
 #include "light.h"
+#include "light_bvh.h"
 #include "material.h"
+#include "material_registry.h"
 #include "ray.h"
 #include "rtweekend.h"
+#include "scene_lights.h"
 
 class camera
 {
@@ -32,18 +35,27 @@ public:
     double defocus_angle = 0; //Variation angle of rays thru each pixel
     double focus_dist = 10; //distance from camera lookfrom point to plane of perfect focus
 
-    void render(const hittable& world)
+    //scenes with fewer lights than this pick them by power alone, the light bvh only pays off with more
+    size_t min_lights_for_bvh = 8;
+
+    //lights are every emissive shape in the world
+    void render(const hittable& world, const material_registry& materials)
     {
-        std::vector<shared_ptr<light>> lights;
-        render(world, lights);
+        render(world, materials, scene_lights::find(world, materials));
     }
-    void render(const hittable& world, const std::vector<shared_ptr<light>>& lights)
+    void render(const hittable& world, const material_registry& materials, const std::vector<shared_ptr<light>>& lights)
     {
         initialize();
+        use_light_bvh = lights.size() >= min_lights_for_bvh;
+        if (use_light_bvh) light_sampler = bvh_light_sampler(lights);
+        else power_sampler = power_light_sampler(lights);
 
         //Render
         std::cout << "P3\n" << image_width << " " << image_height << "\n255\n";
 
+        //scratch memory for the bsdfs along a path, one per rendering thread
+        memory_arena arena;
+
         for (int j = 0; j < image_height; j++) {
             std::clog << "\rScanlines remaining: " << image_height - j << " " << std::flush;
             for (int i = 0; i < image_width; i++) {
@@ -51,7 +63,8 @@ public:
                 for (int sample = 0; sample < samples_per_pixel; sample++)
                 {
                     ray r = get_ray(i, j);
-                    pixel_color+=ray_color(r, max_depth, world, lights); //just a vector3 so we can add
+                    pixel_color+=ray_color(r, max_depth, world, materials, lights, arena); //just a vector3 so we can add
+                    arena.reset(); //the path's bsdfs are done with
                 }
 
                 //pixel_samples_scale is what we need to mult by to average out pixel_color
@@ -73,6 +86,10 @@ private:
     vec3 u, v, w; //camera frame basis vectors
     vec3 defocus_disk_u; //defocus disk horizontal radius
     vec3 defocus_disk_v; //defocus disk vertical radius
+    //over the lights passed to render(), only the one use_light_bvh says gets built
+    bvh_light_sampler light_sampler;
+    power_light_sampler power_sampler;
+    bool use_light_bvh = true;
 
     void initialize()
     {
@@ -139,73 +156,123 @@ private:
         return center + (p[0] * defocus_disk_u + p[1] * defocus_disk_v);
     }
 
-    color ray_color(const ray& r, int depth, const hittable& world, const std::vector<shared_ptr<light>>& lights) const
+    /*
+     * follows one path from the camera. at every vertex light arrives two ways: a shadow ray to a sampled point on a light
+     * (next event estimation), and the bsdf sampled ray happening to hit an emitter. each counts the other's pdf too,
+     * weighted by the power heuristic, so whichever strategy is better for that direction dominates (pbrt 13.4 / Veach ch 9).
+     * delta lobes can't be hit by a light sample, so there's no shadow ray and the emitter they hit counts fully
+     */
+    color ray_color(const ray& r_in, int depth, const hittable& world, const material_registry& materials,
+                    const std::vector<shared_ptr<light>>& lights, memory_arena& arena) const
     {
-        if (depth <= 0)
-        {
-            //weve exceeded ray bounce limit
-            return color(0, 0, 0);
-        }
-        hit_record rec;
+        color radiance(0, 0, 0);
+        color throughput(1, 1, 1); //f * cos / pdf along the path so far
+        ray r = r_in;
+        bool specular_bounce = true; //the camera ray isn't sampled, it sees emitters directly
+        double bsdf_pdf = 0; //pdf of the last bounce's direction
+        point3 prev_p; //the last vertex and its light sampling normal, the light sampler's pick depended on them
+        vec3 prev_n;
 
-        //if ray hits nothing, return background color
-        if (!world.hit(r, interval(0.001, infinity), rec))
+        for (int bounce = 0; bounce < depth; bounce++)
         {
-            return background;
-        }
-        /*ray scattered;
-        color attenuation;
-        color color_from_emission = rec.mat->emitted();
-        if (!rec.mat->scatter(r, rec, attenuation,scattered))
-            return color_from_emission; //no scattering going on
-        std::clog << "ray ior: " << r.current_ior() << " new ray ior: " << scattered.current_ior() << std::endl;
-        color color_from_scatter = attenuation * ray_color(scattered, depth-1, world);
-        return color_from_emission + color_from_scatter;*/
-
-        bsdf b = rec.mat->create_bsdf(rec);
-        //std::clog << b.flags_to_string() << std::endl;
-        //std::clog << b.bxdfs.size() << std::endl;
-        vec3 wo = -r.direction();
-        bsdf_sample sample = b.sample(wo);
-        double cos_theta = dot(wo, rec.normal) / (wo.length() * rec.normal.length());
-        ray scattered = ray(rec.p, sample.wi);
-        color color_from_emission = rec.mat->emitted();
-        //std::clog << sample.f << " " << cos_theta << " " << sample.pdf << std::endl;
-        //BSDF sampling
-        color indirect_color = sample.f * cos_theta * ray_color(scattered, depth - 1, world, lights) / sample.pdf;
-
-        //NEE sampling
-        //NEE
-        std::clog << std::endl;
-        auto& chosen_light = lights[random_int(0, static_cast<int>(lights.size()) - 1)];
-        light_sample l_sample = chosen_light->sample(rec.p);
-        color direct_color;
-        if (l_sample.p_solid_angle > 0)
-        {
-            //std::clog << l_sample.emitted << " " << l_sample.p_solid_angle << std::endl;
-            ray shadow_ray = ray(rec.p, l_sample.wi);
-            hit_record world_shadow_rec;
-            world.hit(shadow_ray, interval(0.001, infinity), world_shadow_rec);
-            hit_record light_rec;
-            chosen_light->hit(shadow_ray, interval(0.001, infinity), light_rec);
-            double epsilon = 1e-8;
-            //std::clog << "time hit world: " << world_shadow_rec.t << " " << "time hit light: " << light_rec.t << std::endl;
-            if (world_shadow_rec.t + epsilon < light_rec.t)
+            hit_record rec;
+            if (!world.hit(r, interval(0, infinity), rec))
+            {
+                radiance += throughput * background;
+                break;
+            }
+            const material& mat = materials[rec.mat];
+
+            //emitter hit by the bsdf sample
+            color emitted = mat.emitted();
+            if (!emitted.near_zero())
             {
-                //the ray hit something before it hit the light rec, so is occluded, no nee
-                direct_color = color(0, 0, 0);
-            }else
+                if (specular_bounce) radiance += throughput * emitted;
+                else radiance += throughput * emitted * power_heuristic(bsdf_pdf, light_pdf(r, rec, prev_p, prev_n, lights));
+            }
+
+            bsdf b = mat.create_bsdf(rec, arena);
+            if (b.num_bxdfs == 0) break;
+            vec3 wo = -unit_vector(r.direction());
+
+            vec3 n = sampling_normal(b);
+            if (is_non_specular(b.flags())) radiance += throughput * sample_light(rec, b, wo, n, world, lights);
+
+            bsdf_sample sample = b.sample(wo);
+            if (sample.pdf == 0 || sample.f.near_zero()) break;
+            throughput = throughput * sample.f * b.abs_cos_theta(sample.wi) / sample.pdf;
+            specular_bounce = sample.is_delta;
+            bsdf_pdf = sample.pdf;
+            prev_p = rec.p;
+            prev_n = n;
+            r = rec.spawn_ray(sample.wi);
+
+            //russian roulette, dim paths stop early and the ones that survive make up for them
+            if (bounce > 3)
             {
-                double pdf = l_sample.p_solid_angle / lights.size();
-                //std::clog << "pdf after dividing by num lights " << pdf << std::endl;
-                //TODO this is just uniform random picking of lights possibly change later
-                direct_color = sample.f * cos_theta * l_sample.emitted / pdf;
+                double keep = std::min(0.95, double(std::max({throughput.x(), throughput.y(), throughput.z()})));
+                if (random_double() >= keep) break;
+                throughput = throughput / keep;
             }
         }
+        return radiance;
+    }
 
-        std::clog << "direct color: " << direct_color << std::endl;
-        return color_from_emission + direct_color;
+    static double power_heuristic(double pdf_f, double pdf_g)
+    {
+        double f = pdf_f * pdf_f, g = pdf_g * pdf_g;
+        if (std::isinf(f)) return 1;
+        return f + g > 0 ? f / (f + g) : 0;
+    }
+
+    //normal the light sampler weighs lights by, zero if light from behind matters too
+    static vec3 sampling_normal(const bsdf& b)
+    {
+        return is_transmission(b.flags()) ? vec3(0, 0, 0) : b.shading.n;
+    }
+
+    //direct light from one light picked by how much it could give this point, with its MIS weight against bsdf sampling
+    color sample_light(const hit_record& rec, const bsdf& b, const vec3& wo, const vec3& n, const hittable& world,
+                       const std::vector<shared_ptr<light>>& lights) const
+    {
+        double pmf;
+        int chosen = use_light_bvh ? light_sampler.sample(rec.p, n, random_double(), pmf) : power_sampler.sample(random_double(), pmf);
+        if (chosen < 0 || pmf == 0) return color(0, 0, 0);
+        light_sample l_sample = lights[chosen]->sample(rec.p);
+        if (l_sample.p_solid_angle <= 0 || l_sample.emitted.near_zero()) return color(0, 0, 0);
+
+        color f = b.f_s(wo, l_sample.wi) * b.abs_cos_theta(l_sample.wi);
+        if (f.near_zero()) return color(0, 0, 0);
+
+        //stop just short of the light, anything hit before that is in the way
+        ray shadow_ray = rec.spawn_ray(l_sample.wi);
+        hit_record blocker;
+        if (world.hit(shadow_ray, interval(0, l_sample.distance * (1 - shadow_epsilon)), blocker)) return color(0, 0, 0);
+
+        double pdf = l_sample.p_solid_angle * pmf;
+        return f * l_sample.emitted * power_heuristic(pdf, b.pdf(wo, l_sample.wi)) / pdf;
+    }
+
+    //the pdf sample_light() would have given the direction r took to the emitter it hit
+    //prev_p and prev_n are the vertex r left from, as passed to sample_light() there
+    double light_pdf(const ray& r, const hit_record& rec, const point3& prev_p, const vec3& prev_n,
+                     const std::vector<shared_ptr<light>>& lights) const
+    {
+        double pdf = 0;
+        auto add = [&](int i)
+        {
+            //not lights further along the ray
+            hit_record light_rec;
+            if (!lights[i]->hit(r, interval(0, rec.t * (1 + shadow_epsilon)), light_rec) || light_rec.t < rec.t * (1 - shadow_epsilon)) return;
+            double pmf = use_light_bvh ? light_sampler.pmf(prev_p, prev_n, i) : power_sampler.pmf(i);
+            if (pmf > 0) pdf += pmf * lights[i]->pdf(r.origin(), light_rec);
+        };
+        //only lights whose bounds hold the hit point can be the one there. without the tree there are few to check
+        if (use_light_bvh) light_sampler.for_each_light_at(rec.p, add);
+        else for (int i = 0; i < int(lights.size()); i++) add(i);
+        return pdf;
     }
+    static constexpr double shadow_epsilon = 1e-4;
 };
 
 #endif //CAMERA_H
@@ -8,7 +8,7 @@
 #include "interval.h"
 #include "vec3.h"
 
-using color = vec3;
+using color = vec3; //float under RT_FLOAT, like every vec3
 
 inline double linear_to_gamma(double linear_component)
 {
@@ -16,6 +16,11 @@ inline double linear_to_gamma(double linear_component)
         return std::sqrt(linear_component);
     return 0; //if negative
 }
+//how bright a linear rgb color looks, rec 709 weights
+inline double luminance(const color& c)
+{
+    return 0.2126 * c.x() + 0.7152 * c.y() + 0.0722 * c.z();
+}
 void write_color(std::ostream& out, const color& pixel_color) {
     auto r = pixel_color.x();
     auto g = pixel_color.y();
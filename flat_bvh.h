@@ -0,0 +1,662 @@
+//
+// Created by Faye Yu on 1/8/26.
+//
+
+#ifndef FLAT_BVH_H
+#define FLAT_BVH_H
+
+#include <algorithm>
+#include <cstdint>
+#include <numeric>
+#include <queue>
+#include <span>
+#include <vector>
+#include "aabb.h"
+
+//32 bytes so two nodes share a cache line
+//bounds are stored as floats rounded outwards so they stay conservative
+struct flat_bvh_node
+{
+    float min[3];
+    std::uint32_t offset; //leaf: first index into prim_indices, interior: index of the first child (the second child is right after it)
+    float max[3];
+    std::uint16_t count; //number of primitives in a leaf, 0 for interior nodes
+    std::uint16_t axis; //split axis, used to visit the nearer child first
+};
+static_assert(sizeof(flat_bvh_node) == 32);
+
+class flat_bvh
+{
+/*
+ * compact bvh over primitives that aren't hittables of their own (ex: spheres in a sphere_set).
+ * siblings are stored next to each other on an even index, so a pair always shares a cache line,
+ * and pairs are grouped into 4KB page sized treelets (bigger subtrees first) so a ray walking down the tree
+ * touches few pages. that matters most when the nodes are memory mapped and paged in by the OS.
+ * the owner intersects the leaves itself
+ */
+public:
+    static constexpr std::uint32_t nodes_per_page = 4096 / sizeof(flat_bvh_node);
+
+    std::vector<std::uint32_t> prim_indices; //leaf ranges index into this, it maps to the owner's primitive index
+
+    //a tree over one batch of primitives, built on its own so batches can be built as they arrive and joined after
+    struct part
+    {
+        std::vector<flat_bvh_node> nodes; //depth first, not grouped into pages yet
+        std::vector<std::uint32_t> prim_indices; //into the batch's primitives
+    };
+
+    /**
+     * @param prim_bounds
+     * @param max_leaf_size
+     * @param group_starts sorted primitive indices where a new group starts (ex: a new material).
+     * the tree splits on these before anything else, so no leaf mixes groups and every group stays a contiguous run
+     * of prim_indices in its original place
+     */
+    void build(const std::vector<aabb>& prim_bounds, std::uint32_t max_leaf_size,
+               std::vector<std::uint32_t> group_starts = {})
+    {
+        external = {};
+        part whole = build_part(prim_bounds, max_leaf_size, std::move(group_starts));
+        prim_indices = std::move(whole.prim_indices);
+        storage = whole.nodes.empty() ? std::vector<flat_bvh_node>() : cluster_into_pages(whole.nodes);
+        depth = measure_depth(storage);
+    }
+
+    //see build(), the part's leaves and groups are kept as they are when it's joined
+    static part build_part(const std::vector<aabb>& prim_bounds, std::uint32_t max_leaf_size,
+                           std::vector<std::uint32_t> group_starts = {})
+    {
+        flat_bvh builder;
+        builder.groups = std::move(group_starts);
+        builder.prim_indices.resize(prim_bounds.size());
+        std::iota(builder.prim_indices.begin(), builder.prim_indices.end(), 0);
+        part result;
+        if (prim_bounds.empty()) return result;
+
+        std::vector<point3> centroids;
+        centroids.reserve(prim_bounds.size());
+        for (const aabb& b : prim_bounds) centroids.push_back(b.get_centroid());
+
+        result.nodes.reserve(2 * prim_bounds.size() / max_leaf_size + 1);
+        result.nodes.emplace_back();
+        builder.build_recursive(result.nodes, prim_bounds, centroids, 0, 0, static_cast<std::uint32_t>(prim_bounds.size()), max_leaf_size, 1);
+        result.prim_indices = std::move(builder.prim_indices);
+        return result;
+    }
+
+    /**
+     * Makes one tree out of parts built separately. primitives are numbered through the parts in order
+     * (the second part's first primitive comes right after the first part's last), and prim_indices is the parts'
+     * prim_indices one after the other, so groups inside a part stay where they were.
+     * each part is cut into subtrees of at most join_cut_size primitives and a new top is built over those with SAH,
+     * so parts that overlap in space (ex: consecutive chunks of a file) still get a good tree
+     */
+    void join(std::vector<part> parts)
+    {
+        external = {};
+        prim_indices.clear();
+        if (parts.size() == 1)
+        {
+            prim_indices = std::move(parts[0].prim_indices);
+            storage = parts[0].nodes.empty() ? std::vector<flat_bvh_node>() : cluster_into_pages(parts[0].nodes);
+            depth = measure_depth(storage);
+            return;
+        }
+        std::vector<flat_bvh_node> items; //cut subtree roots
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> item_sources; //(part, node) of each
+        for (std::uint32_t k = 0; k < parts.size(); k++)
+        {
+            part& p = parts[k];
+            if (p.nodes.empty()) continue;
+            auto base = static_cast<std::uint32_t>(prim_indices.size());
+            for (std::uint32_t& prim : p.prim_indices) prim += base;
+            for (flat_bvh_node& node : p.nodes)
+            {
+                if (node.count > 0) node.offset += base;
+            }
+            prim_indices.insert(prim_indices.end(), p.prim_indices.begin(), p.prim_indices.end());
+            p.prim_indices = std::vector<std::uint32_t>();
+
+            //subtree sizes, children always come after their parent in depth first order
+            std::vector<std::uint32_t> size(p.nodes.size());
+            for (auto i = static_cast<std::uint32_t>(p.nodes.size()); i-- > 0;)
+            {
+                const flat_bvh_node& node = p.nodes[i];
+                size[i] = node.count > 0 ? node.count : size[node.offset] + size[node.offset + 1];
+            }
+            std::vector<std::uint32_t> stack = {0};
+            while (!stack.empty())
+            {
+                std::uint32_t i = stack.back();
+                stack.pop_back();
+                if (p.nodes[i].count > 0 || size[i] <= join_cut_size)
+                {
+                    items.push_back(p.nodes[i]);
+                    item_sources.emplace_back(k, i);
+                    continue;
+                }
+                stack.push_back(p.nodes[i].offset);
+                stack.push_back(p.nodes[i].offset + 1);
+            }
+        }
+        if (items.empty())
+        {
+            storage.clear();
+            depth = 0;
+            return;
+        }
+
+        //the top tree's leaves are single items, each replaced by the subtree it stands for
+        std::vector<aabb> item_bounds;
+        item_bounds.reserve(items.size());
+        for (const flat_bvh_node& item : items) item_bounds.push_back(node_bounds(item));
+        part top = build_part(item_bounds, 1);
+
+        std::vector<flat_bvh_node> built;
+        built.reserve(top.nodes.size() + prim_indices.size());
+        built.push_back(top.nodes[0]);
+        //(node in built, node in top) still to fill in
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pending = {{0, 0}};
+        while (!pending.empty())
+        {
+            auto [to, from] = pending.back();
+            pending.pop_back();
+            const flat_bvh_node& node = top.nodes[from];
+            if (node.count == 0)
+            {
+                auto first_child = static_cast<std::uint32_t>(built.size());
+                built.push_back(top.nodes[node.offset]);
+                built.push_back(top.nodes[node.offset + 1]);
+                built[to].offset = first_child;
+                pending.emplace_back(first_child, node.offset);
+                pending.emplace_back(first_child + 1, node.offset + 1);
+                continue;
+            }
+            auto [k, i] = item_sources[top.prim_indices[node.offset]];
+            copy_subtree(parts[k].nodes, i, built, to);
+        }
+        storage = cluster_into_pages(built);
+        depth = measure_depth(storage);
+    }
+    /**
+     * Use nodes that live somewhere else (ex: a memory mapped file) instead of building them
+     * @param tree_depth from measure_depth() or another flat_bvh's tree_depth()
+     */
+    void attach(std::span<const flat_bvh_node> mapped_nodes, std::uint32_t tree_depth)
+    {
+        storage.clear();
+        storage.shrink_to_fit();
+        external = mapped_nodes;
+        depth = tree_depth;
+    }
+
+    //points every leaf at new_offset(its offset), for an owner that moved blocks of prim_indices around
+    template <typename Fn>
+    void move_leaves(Fn&& new_offset)
+    {
+        for (flat_bvh_node& node : storage)
+        {
+            if (node.count > 0) node.offset = new_offset(node.offset);
+        }
+    }
+
+    /**
+     * Recomputes every node's bounds and keeps the tree as it is, for primitives that moved a little
+     * (ex: snapped to a quantization grid after the build)
+     * @param prim_bounds called as prim_bounds(primitive) with the index prim_indices maps to
+     */
+    template <typename BoundsFn>
+    void refit(BoundsFn&& prim_bounds)
+    {
+        if (storage.empty()) return;
+        //children first, (node, its children are done)
+        std::vector<std::pair<std::uint32_t, bool>> pending = {{0, false}};
+        while (!pending.empty())
+        {
+            auto [i, children_done] = pending.back();
+            pending.pop_back();
+            flat_bvh_node& node = storage[i];
+            aabb bbox = aabb::empty;
+            if (node.count > 0)
+            {
+                for (std::uint32_t k = node.offset; k < node.offset + node.count; k++)
+                {
+                    bbox = aabb(bbox, prim_bounds(prim_indices.empty() ? k : prim_indices[k]));
+                }
+            }
+            else if (!children_done)
+            {
+                pending.emplace_back(i, true);
+                pending.emplace_back(node.offset, false);
+                pending.emplace_back(node.offset + 1, false);
+                continue;
+            }
+            else bbox = aabb(node_bounds(storage[node.offset]), node_bounds(storage[node.offset + 1]));
+            for (int a = 0; a < 3; a++)
+            {
+                node.min[a] = round_down(bbox.axis_interval(a).min);
+                node.max[a] = round_up(bbox.axis_interval(a).max);
+            }
+        }
+    }
+
+    //nodes on the longest path from the root to a leaf
+    std::uint32_t tree_depth() const { return depth; }
+    static std::uint32_t measure_depth(std::span<const flat_bvh_node> nodes)
+    {
+        if (nodes.empty()) return 0;
+        std::uint32_t deepest = 0;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pending = {{0, 1}}; //(node, its depth)
+        while (!pending.empty())
+        {
+            auto [i, d] = pending.back();
+            pending.pop_back();
+            deepest = std::max(deepest, d);
+            if (nodes[i].count > 0) continue;
+            pending.emplace_back(nodes[i].offset, d + 1);
+            pending.emplace_back(nodes[i].offset + 1, d + 1);
+        }
+        return deepest;
+    }
+
+    std::span<const flat_bvh_node> nodes() const
+    {
+        return external.empty() ? std::span<const flat_bvh_node>(storage) : external;
+    }
+
+    /**
+     * Walks the nodes the ray passes through, nearest child first
+     * @param intersect_leaf called as intersect_leaf(first, count, ray_t) for every leaf reached,
+     * returns true on a hit and shrinks ray_t.max to the hit time
+     * @return if any leaf reported a hit
+     */
+    template <typename LeafFn>
+    bool traverse(const ray& r, interval ray_t, LeafFn&& intersect_leaf) const
+    {
+        if (this->nodes().empty()) return false;
+        //a path holds at most depth - 1 far children, trees deeper than the stack (ex: mapped from an old file) take the slow path
+        if (depth > max_stack_depth)
+        {
+            std::vector<std::uint32_t> stack(depth);
+            return traverse(r, ray_t, intersect_leaf, stack.data(), depth);
+        }
+        std::uint32_t stack[max_stack_depth];
+        return traverse(r, ray_t, intersect_leaf, stack, max_stack_depth);
+    }
+
+    aabb bounding_box() const
+    {
+        std::span<const flat_bvh_node> nodes = this->nodes();
+        if (nodes.empty()) return aabb::empty;
+        return node_bounds(nodes[0]);
+    }
+private:
+    std::vector<flat_bvh_node> storage;
+    std::span<const flat_bvh_node> external;
+    std::vector<std::uint32_t> groups; //group_starts while building
+    std::uint32_t depth = 0;
+
+    //subtrees up to this many primitives are kept as they are by join(), bigger ones are rebuilt at the top
+    static constexpr std::uint32_t join_cut_size = 1024;
+    //traverse() keeps its stack on the call stack up to this depth
+    static constexpr std::uint32_t max_stack_depth = 64;
+    //deeper than this nodes split by count instead of SAH, so a degenerate build stays within a few dozen levels
+    static constexpr std::uint32_t balanced_depth = 24;
+
+    template <typename LeafFn>
+    bool traverse(const ray& r, interval ray_t, LeafFn& intersect_leaf, std::uint32_t* stack, std::uint32_t capacity) const
+    {
+        std::span<const flat_bvh_node> nodes = this->nodes();
+
+        float origin[3], inv_dir[3];
+        bool dir_neg[3];
+        for (int a = 0; a < 3; a++)
+        {
+            origin[a] = static_cast<float>(r.origin()[a]);
+            inv_dir[a] = static_cast<float>(1.0 / r.direction()[a]);
+            dir_neg[a] = inv_dir[a] < 0;
+        }
+
+        int stack_size = 0;
+        std::uint32_t current = 0;
+        bool hit_anything = false;
+        while (true)
+        {
+            const flat_bvh_node& node = nodes[current];
+            if (hit_node(node, origin, inv_dir, ray_t))
+            {
+                if (node.count > 0)
+                {
+                    if (intersect_leaf(node.offset, static_cast<std::uint32_t>(node.count), ray_t)) hit_anything = true;
+                    if (stack_size == 0) break;
+                    current = stack[--stack_size];
+                }
+                else
+                {
+                    //the second child is on the far side of the split, so it's nearer when going down the axis
+                    std::uint32_t near_child = node.offset + (dir_neg[node.axis] ? 1 : 0);
+                    //only a tree deeper than its recorded depth (ex: a corrupt mapped file) fills the stack,
+                    //it loses far children instead of writing past the end
+                    if (std::uint32_t(stack_size) < capacity) stack[stack_size++] = node.offset + (dir_neg[node.axis] ? 0 : 1);
+                    current = near_child;
+                }
+            }
+            else
+            {
+                if (stack_size == 0) break;
+                current = stack[--stack_size];
+            }
+        }
+        return hit_anything;
+    }
+
+    static aabb node_bounds(const flat_bvh_node& node)
+    {
+        return aabb(interval(node.min[0], node.max[0]), interval(node.min[1], node.max[1]), interval(node.min[2], node.max[2]));
+    }
+
+    //copies the subtree under from[root] into to, with its root going to to[at]
+    static void copy_subtree(const std::vector<flat_bvh_node>& from, std::uint32_t root,
+                             std::vector<flat_bvh_node>& to, std::uint32_t at)
+    {
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pending = {{at, root}};
+        while (!pending.empty())
+        {
+            auto [dst, src] = pending.back();
+            pending.pop_back();
+            to[dst] = from[src];
+            if (from[src].count > 0) continue;
+            auto first_child = static_cast<std::uint32_t>(to.size());
+            to.emplace_back();
+            to.emplace_back();
+            to[dst].offset = first_child;
+            pending.emplace_back(first_child, from[src].offset);
+            pending.emplace_back(first_child + 1, from[src].offset + 1);
+        }
+    }
+
+    static bool hit_node(const flat_bvh_node& node, const float origin[3], const float inv_dir[3], const interval& ray_t)
+    {
+        float t_min = static_cast<float>(ray_t.min);
+        float t_max = static_cast<float>(ray_t.max);
+        for (int axis = 0; axis < 3; axis++)
+        {
+            float t_enter = (node.min[axis] - origin[axis]) * inv_dir[axis];
+            float t_exit = (node.max[axis] - origin[axis]) * inv_dir[axis];
+            if (t_enter > t_exit) std::swap(t_enter, t_exit);
+            //pad the exit so float rounding can't make us miss a box the ray grazes (pbrt 6.8.2)
+            t_exit *= 1 + 2 * 3 * std::numeric_limits<float>::epsilon();
+            t_min = t_enter > t_min ? t_enter : t_min;
+            t_max = t_exit < t_max ? t_exit : t_max;
+            if (t_min > t_max) return false;
+        }
+        return true;
+    }
+
+    static float round_down(real x)
+    {
+        auto f = static_cast<float>(x);
+        return f > x ? std::nextafter(f, -std::numeric_limits<float>::infinity()) : f;
+    }
+    static float round_up(real x)
+    {
+        auto f = static_cast<float>(x);
+        return f < x ? std::nextafter(f, std::numeric_limits<float>::infinity()) : f;
+    }
+
+    void build_recursive(std::vector<flat_bvh_node>& built, const std::vector<aabb>& prim_bounds,
+                         const std::vector<point3>& centroids, std::uint32_t node_index,
+                         std::uint32_t start, std::uint32_t end, std::uint32_t max_leaf_size, std::uint32_t node_depth)
+    {
+        aabb bbox = aabb::empty;
+        aabb centroid_bounds = aabb::empty;
+        for (std::uint32_t i = start; i < end; i++)
+        {
+            bbox = aabb(bbox, prim_bounds[prim_indices[i]]);
+            const point3& c = centroids[prim_indices[i]];
+            centroid_bounds = aabb(centroid_bounds, aabb(c, c));
+        }
+        for (int a = 0; a < 3; a++)
+        {
+            built[node_index].min[a] = round_down(bbox.axis_interval(a).min);
+            built[node_index].max[a] = round_up(bbox.axis_interval(a).max);
+        }
+
+        std::uint32_t count = end - start;
+        auto first_group = std::upper_bound(groups.begin(), groups.end(), start);
+        auto last_group = std::lower_bound(groups.begin(), groups.end(), end);
+        if (first_group != last_group)
+        {
+            //the range holds more than one group, split between groups first
+            split_groups(built, prim_bounds, centroids, node_index, start, end, first_group, last_group, max_leaf_size, node_depth);
+            return;
+        }
+        if (count <= max_leaf_size)
+        {
+            make_leaf(built[node_index], start, count);
+            return;
+        }
+
+        int axis = centroid_bounds.longest_axis();
+        std::uint32_t mid = node_depth < balanced_depth ? split_sah(prim_bounds, centroids, start, end, axis, centroid_bounds.axis_interval(axis)) : start;
+        if (mid == start || mid == end)
+        {
+            //all centroids in one bucket (or too deep already), fall back to splitting the range in half
+            mid = start + count / 2;
+            std::nth_element(prim_indices.begin() + start, prim_indices.begin() + mid, prim_indices.begin() + end,
+                [&](std::uint32_t a, std::uint32_t b){ return centroids[a][axis] < centroids[b][axis]; });
+        }
+
+        //indices only, built reallocates as it grows
+        auto first_child = static_cast<std::uint32_t>(built.size());
+        built.emplace_back();
+        built.emplace_back();
+        built[node_index].offset = first_child;
+        built[node_index].count = 0;
+        built[node_index].axis = static_cast<std::uint16_t>(axis);
+        build_recursive(built, prim_bounds, centroids, first_child, start, mid, max_leaf_size, node_depth + 1);
+        build_recursive(built, prim_bounds, centroids, first_child + 1, mid, end, max_leaf_size, node_depth + 1);
+    }
+
+    //picks the group boundary with the lowest SAH cost. primitives don't move, so groups keep their runs
+    void split_groups(std::vector<flat_bvh_node>& built, const std::vector<aabb>& prim_bounds,
+                      const std::vector<point3>& centroids, std::uint32_t node_index,
+                      std::uint32_t start, std::uint32_t end,
+                      std::vector<std::uint32_t>::const_iterator first_group,
+                      std::vector<std::uint32_t>::const_iterator last_group, std::uint32_t max_leaf_size,
+                      std::uint32_t node_depth)
+    {
+        //runs [start, b0), [b0, b1), ..., [bk, end) for the boundaries b inside the range
+        std::vector<std::uint32_t> cuts = {start};
+        cuts.insert(cuts.end(), first_group, last_group);
+        cuts.push_back(end);
+        size_t num_runs = cuts.size() - 1;
+        std::vector<aabb> run_bounds(num_runs, aabb::empty);
+        for (size_t r = 0; r < num_runs; r++)
+        {
+            for (std::uint32_t i = cuts[r]; i < cuts[r + 1]; i++) run_bounds[r] = aabb(run_bounds[r], prim_bounds[prim_indices[i]]);
+        }
+
+        std::vector<aabb> right_bounds(num_runs);
+        right_bounds[num_runs - 1] = run_bounds[num_runs - 1];
+        for (size_t r = num_runs - 1; r-- > 0;) right_bounds[r] = aabb(run_bounds[r], right_bounds[r + 1]);
+
+        size_t best = 1;
+        real min_cost = infinity;
+        if (node_depth >= balanced_depth)
+        {
+            best = num_runs / 2; //too deep already, halve the runs so the rest stays shallow
+        }
+        else
+        {
+            aabb left = aabb::empty;
+            for (size_t r = 1; r < num_runs; r++)
+            {
+                left = aabb(left, run_bounds[r - 1]);
+                real cost = left.surface_area() * (cuts[r] - start) + right_bounds[r].surface_area() * (end - cuts[r]);
+                if (cost < min_cost)
+                {
+                    min_cost = cost;
+                    best = r;
+                }
+            }
+        }
+        std::uint32_t mid = cuts[best];
+
+        //split axis is where the two sides are furthest apart, and the lower side goes first for traversal order
+        aabb left_box = aabb::empty;
+        for (size_t r = 0; r < best; r++) left_box = aabb(left_box, run_bounds[r]);
+        point3 left_center = left_box.get_centroid();
+        point3 right_center = right_bounds[best].get_centroid();
+        int axis = 0;
+        for (int a = 1; a < 3; a++)
+        {
+            if (std::fabs(right_center[a] - left_center[a]) > std::fabs(right_center[axis] - left_center[axis])) axis = a;
+        }
+        bool swap_children = right_center[axis] < left_center[axis];
+
+        auto first_child = static_cast<std::uint32_t>(built.size());
+        built.emplace_back();
+        built.emplace_back();
+        built[node_index].offset = first_child;
+        built[node_index].count = 0;
+        built[node_index].axis = static_cast<std::uint16_t>(axis);
+        build_recursive(built, prim_bounds, centroids, first_child + (swap_children ? 1 : 0), start, mid, max_leaf_size, node_depth + 1);
+        build_recursive(built, prim_bounds, centroids, first_child + (swap_children ? 0 : 1), mid, end, max_leaf_size, node_depth + 1);
+    }
+
+    static void make_leaf(flat_bvh_node& node, std::uint32_t start, std::uint32_t count)
+    {
+        node.offset = start;
+        node.count = static_cast<std::uint16_t>(count);
+        node.axis = 0;
+    }
+
+    static real pair_area(const std::vector<flat_bvh_node>& built, std::uint32_t pair)
+    {
+        real area = 0;
+        for (std::uint32_t k = pair; k < pair + 2; k++)
+        {
+            const flat_bvh_node& n = built[k];
+            real dx = n.max[0] - n.min[0], dy = n.max[1] - n.min[1], dz = n.max[2] - n.min[2];
+            area += dx*dy + dy*dz + dz*dx;
+        }
+        return area;
+    }
+
+    /*
+     * fills each page with a treelet: starting from a sibling pair, keep adding the child pair
+     * with the most surface area (the one rays are most likely to visit) until the page is full.
+     * pairs that didn't fit start treelets of their own, and small subtrees share pages instead of padding them out
+     */
+    static std::vector<flat_bvh_node> cluster_into_pages(const std::vector<flat_bvh_node>& built)
+    {
+        std::vector<flat_bvh_node> out;
+        out.reserve(built.size() + 1);
+        std::vector<std::uint32_t> new_index(built.size());
+        new_index[0] = 0;
+        out.push_back(built[0]);
+        if (built[0].count > 0) return out; //the whole tree is one leaf
+        out.emplace_back(); //unused, so pairs start on even indices
+
+        std::vector<std::uint32_t> treelet_roots = {built[0].offset};
+        std::priority_queue<std::pair<real, std::uint32_t>> candidates;
+        auto slots_left = nodes_per_page - 2;
+        for (size_t next_root = 0; next_root < treelet_roots.size(); next_root++)
+        {
+            candidates.emplace(pair_area(built, treelet_roots[next_root]), treelet_roots[next_root]);
+            while (!candidates.empty())
+            {
+                if (slots_left == 0)
+                {
+                    //page is full, whatever's left gets its own treelet later
+                    while (!candidates.empty())
+                    {
+                        treelet_roots.push_back(candidates.top().second);
+                        candidates.pop();
+                    }
+                    slots_left = nodes_per_page;
+                    break;
+                }
+                std::uint32_t pair = candidates.top().second;
+                candidates.pop();
+                for (std::uint32_t k = pair; k < pair + 2; k++)
+                {
+                    new_index[k] = static_cast<std::uint32_t>(out.size());
+                    out.push_back(built[k]);
+                    if (built[k].count == 0) candidates.emplace(pair_area(built, built[k].offset), built[k].offset);
+                }
+                slots_left -= 2;
+            }
+        }
+
+        //children moved too, point interior nodes at their new spots
+        for (std::uint32_t i = 0; i < built.size(); i++)
+        {
+            if (built[i].count == 0) out[new_index[i]].offset = new_index[built[i].offset];
+        }
+        return out;
+    }
+
+    //binned SAH, returns the first index of the right child (or start/end if every split is degenerate)
+    std::uint32_t split_sah(const std::vector<aabb>& prim_bounds, const std::vector<point3>& centroids,
+                            std::uint32_t start, std::uint32_t end, int axis, const interval& extent)
+    {
+        constexpr int num_buckets = 12;
+        if (extent.size() <= 0) return start;
+
+        auto bucket_of = [&](std::uint32_t prim)
+        {
+            int b = static_cast<int>(num_buckets * (centroids[prim][axis] - extent.min) / extent.size());
+            return std::clamp(b, 0, num_buckets - 1);
+        };
+
+        std::uint32_t counts[num_buckets] = {};
+        aabb bounds[num_buckets];
+        for (auto& b : bounds) b = aabb::empty;
+        for (std::uint32_t i = start; i < end; i++)
+        {
+            int b = bucket_of(prim_indices[i]);
+            counts[b]++;
+            bounds[b] = aabb(bounds[b], prim_bounds[prim_indices[i]]);
+        }
+
+        //sweep from the right so each split's right side cost is known in one pass
+        real right_area[num_buckets];
+        std::uint32_t right_count[num_buckets];
+        aabb right = aabb::empty;
+        std::uint32_t n = 0;
+        for (int b = num_buckets - 1; b > 0; b--)
+        {
+            right = aabb(right, bounds[b]);
+            n += counts[b];
+            right_area[b] = n > 0 ? right.surface_area() : 0;
+            right_count[b] = n;
+        }
+
+        int best_split = -1;
+        real min_cost = infinity;
+        aabb left = aabb::empty;
+        n = 0;
+        for (int b = 0; b < num_buckets - 1; b++)
+        {
+            left = aabb(left, bounds[b]);
+            n += counts[b];
+            if (n == 0 || right_count[b+1] == 0) continue;
+            real cost = left.surface_area() * n + right_area[b+1] * right_count[b+1];
+            if (cost < min_cost)
+            {
+                min_cost = cost;
+                best_split = b;
+            }
+        }
+        if (best_split < 0) return start;
+
+        auto mid = std::partition(prim_indices.begin() + start, prim_indices.begin() + end,
+            [&](std::uint32_t prim){ return bucket_of(prim) <= best_split; });
+        return static_cast<std::uint32_t>(mid - prim_indices.begin());
+    }
+};
+
+#endif //FLAT_BVH_H
@@ -0,0 +1,39 @@
+//
+// Created by Faye Yu on 1/20/26.
+//
+
+#ifndef FRAME_H
+#define FRAME_H
+
+#include "vec3.h"
+
+//orthonormal basis (s, t, n), used to move directions in and out of a bxdf's local space where n is +z
+class frame
+{
+public:
+    vec3 s = vec3(1, 0, 0);
+    vec3 t = vec3(0, 1, 0);
+    vec3 n = vec3(0, 0, 1);
+
+    frame() = default;
+    frame(const vec3& s, const vec3& t, const vec3& n) : s(s), t(t), n(n) {}
+
+    /*
+     * basis around a unit normal without branches or normalizing (Duff et al. 2017,
+     * "Building an Orthonormal Basis, Revisited"), continuous everywhere except where the sign of n.z flips
+     */
+    static frame from_z(const vec3& n)
+    {
+        real sign = std::copysign(real(1), n.z());
+        real a = -1 / (sign + n.z());
+        real b = n.x() * n.y() * a;
+        return frame(vec3(1 + sign * n.x() * n.x() * a, sign * b, -sign * n.x()),
+                     vec3(b, sign + n.y() * n.y() * a, -n.y()),
+                     n);
+    }
+
+    vec3 to_local(const vec3& v) const { return vec3(dot(v, s), dot(v, t), dot(v, n)); }
+    vec3 from_local(const vec3& v) const { return v.x() * s + v.y() * t + v.z() * n; }
+};
+
+#endif //FRAME_H
@@ -4,6 +4,8 @@
 
 #ifndef FRESNEL_H
 #define FRESNEL_H
+#include <algorithm>
+#include <utility>
 #include "color.h"
 
 class fresnel
@@ -11,33 +13,66 @@ class fresnel
 public:
     virtual ~fresnel() = default;
 
-    virtual double evaluate(double cos_i) = 0;
+    //fraction of light reflected at cos_i, per channel
+    virtual color evaluate(double cos_i) const = 0;
 };
 
+//metal boundary, light that isn't reflected is absorbed. eta + i*k is the metal's complex ior (per rgb channel)
 class fresnel_conductor : public fresnel
 {
 public:
-    fresnel_conductor(double eta_i, double eta_t, double k) : eta_i(eta_i), eta_t(eta_t), k_t(k) {}
+    fresnel_conductor(double eta_i, const color& eta_t, const color& k) : eta(eta_t / eta_i), k(k / eta_i) {}
 
-    double evaluate(double cos_theta_i) override
+    color evaluate(double cos_theta_i) const override
     {
-        return Fr_conductor(cos_theta_i);
+        return reflectance(cos_theta_i, eta, k);
     }
-private:
-    double eta_i, eta_t, k_t;
+    /*
+     * exact fresnel for a conductor, pbrt 8.2.2. eta and k are relative to the medium the light comes from.
+     * with k = 0 this is the same as a dielectric
+     */
+    static color reflectance(double cos_theta_i, const color& eta, const color& k)
+    {
+        cos_theta_i = std::clamp(cos_theta_i, -1.0, 1.0);
+        double cos2 = cos_theta_i * cos_theta_i;
+        double sin2 = 1 - cos2;
+        color result;
+        for (int c = 0; c < 3; c++)
+        {
+            double eta2 = eta[c] * eta[c];
+            double k2 = k[c] * k[c];
+
+            double t0 = eta2 - k2 - sin2;
+            double a2_b2 = std::sqrt(std::max(0.0, t0 * t0 + 4 * eta2 * k2));
+            double a = std::sqrt(std::max(0.0, 0.5 * (a2_b2 + t0)));
 
-    double Fr_conductor(double cos_theta_i){
-        /*double eta = eta_t / eta_i;
-        double k = k_t / eta_i;
+            double t1 = a2_b2 + cos2;
+            double t2 = 2 * std::abs(cos_theta_i) * a;
+            double r_perp = (t1 - t2) / (t1 + t2);
 
-        double cos_squared = cos_theta_i * cos_theta_i;
-        double ab_temp = eta*eta - k*k - (1-cos_squared);
-        double a2_b2 = sqrt(ab_temp * ab_temp + 4 * eta * eta * k * k);
+            double t3 = cos2 * a2_b2 + sin2 * sin2;
+            double t4 = t2 * sin2;
+            double r_parallel = r_perp * (t3 - t4) / (t3 + t4);
 
-        double r_perp = a2_b2 - 2 *
-        */
-        return 1.0;
+            result[c] = 0.5 * (r_parallel + r_perp);
+        }
+        return result;
+    }
+    /*
+     * a metal that reflects reflectivity head on (Gulbrandsen 2014, "Artist Friendly Metallic Fresnel",
+     * with the edge tint at white). lets a metal be made from just an albedo
+     */
+    static void from_reflectivity(const color& reflectivity, color& eta, color& k)
+    {
+        for (int c = 0; c < 3; c++)
+        {
+            double r = std::clamp(double(reflectivity[c]), 0.0, 0.999);
+            eta[c] = (1 - r) / (1 + r);
+            k[c] = std::sqrt(std::max(0.0, (r * (eta[c] + 1) * (eta[c] + 1) - (eta[c] - 1) * (eta[c] - 1)) / (1 - r)));
+        }
     }
+private:
+    color eta, k;
 };
 
 class fresnel_dielectric : public fresnel
@@ -45,27 +80,24 @@ class fresnel_dielectric : public fresnel
 public:
     fresnel_dielectric(double eta_i, double eta_t) : eta_i(eta_i), eta_t(eta_t) {}
 
-    double evaluate(double cos_theta_i) override
+    color evaluate(double cos_theta_i) const override
     {
-        return Fr_dielectric(cos_theta_i);
+        double r = reflectance(cos_theta_i, eta_i, eta_t);
+        return color(r, r, r);
     }
-private:
-    double eta_i;
-    double eta_t;
 
     //eta_i : index of refraction for incident material
     //eta_t : index of refraction for transmitted material
     //returns how much light is reflected (0 = none, 1 = all)
-    double Fr_dielectric(double cos_theta_i)
+    static double reflectance(double cos_theta_i, double eta_i, double eta_t)
     {
         if (cos_theta_i < 0)
         {
             //the ray is on the inside, swap the etas
-            double temp = eta_i;
-            eta_i = eta_t;
-            eta_t = temp;
+            std::swap(eta_i, eta_t);
             cos_theta_i = std::abs(cos_theta_i); //ensure cos_theta_i is nonneg
         }
+        cos_theta_i = std::min(cos_theta_i, 1.0);
 
         //find cos_theta_t using snell's law
         double sin_theta_i = std::sqrt(std::max(static_cast<double>(0), 1 - cos_theta_i * cos_theta_i));
@@ -83,6 +115,9 @@ private:
 
         return (r_parallel * r_parallel + r_perp * r_perp) / 2;
     }
+private:
+    double eta_i;
+    double eta_t;
 };
 
 #endif //FRESNEL_H
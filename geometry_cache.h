@@ -0,0 +1,95 @@
+//
+// Created by Faye Yu on 1/12/26.
+//
+
+#ifndef GEOMETRY_CACHE_H
+#define GEOMETRY_CACHE_H
+
+#include <functional>
+#include <list>
+#include <mutex>
+#include <unordered_map>
+#include "hittable.h"
+
+class geometry_cache
+{
+/*
+ * least recently used cache for geometry that gets built on demand (ex: tessellated patches).
+ * once the entries' total size goes over the budget the coldest ones are dropped, and rebuilt if a ray needs them again.
+ * entries are shared_ptrs so evicting one a ray is still traversing doesn't free it out from under the ray
+ */
+public:
+    struct built_geometry
+    {
+        shared_ptr<hittable> geometry;
+        size_t bytes; //estimated memory used by geometry
+    };
+
+    explicit geometry_cache(size_t budget_bytes) : budget(budget_bytes) {}
+
+    /**
+     * @param key identifies the geometry, ex: the address of the patch that owns it
+     * @param build called on a miss to create the geometry
+     * @return the cached geometry for key, building it first if it isn't resident
+     */
+    shared_ptr<hittable> get(const void* key, const std::function<built_geometry()>& build)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m);
+            auto it = index.find(key);
+            if (it != index.end())
+            {
+                lru.splice(lru.begin(), lru, it->second); //mark as most recently used
+                hits++;
+                return it->second->geometry;
+            }
+            misses++;
+        }
+
+        //build without holding the lock so other patches stay available meanwhile
+        built_geometry built = build();
+
+        std::lock_guard<std::mutex> lock(m);
+        auto it = index.find(key);
+        if (it != index.end()) return it->second->geometry; //someone else built it first
+        lru.push_front(entry{key, built.geometry, built.bytes});
+        index[key] = lru.begin();
+        used += built.bytes;
+        evict();
+        return built.geometry;
+    }
+
+    size_t used_bytes() const { return used; }
+    size_t budget_bytes() const { return budget; }
+    size_t num_hits() const { return hits; }
+    size_t num_misses() const { return misses; }
+private:
+    struct entry
+    {
+        const void* key;
+        shared_ptr<hittable> geometry;
+        size_t bytes;
+    };
+
+    size_t budget;
+    size_t used = 0;
+    size_t hits = 0;
+    size_t misses = 0;
+    std::list<entry> lru; //front is the most recently used
+    std::unordered_map<const void*, std::list<entry>::iterator> index;
+    std::mutex m;
+
+    void evict()
+    {
+        //always keep the newest entry, even if it alone is over budget
+        while (used > budget && lru.size() > 1)
+        {
+            const entry& coldest = lru.back();
+            used -= coldest.bytes;
+            index.erase(coldest.key);
+            lru.pop_back();
+        }
+    }
+};
+
+#endif //GEOMETRY_CACHE_H
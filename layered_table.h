@@ -0,0 +1,211 @@
+//
+// Created by Faye Yu on 1/22/26.
+//
+
+#ifndef LAYERED_TABLE_H
+#define LAYERED_TABLE_H
+
+#include <exception>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <tuple>
+#include "bxdf.h"
+
+//what's under a clear coat
+struct layer_stack
+{
+    bool metal_base = false;
+    color albedo = color(0, 0, 0); //diffuse base
+    color eta = color(1, 1, 1), k = color(0, 0, 0); //metal base, relative to outside the coat
+    double base_roughness = 0;
+    double coat_ior = 1.5;
+
+    bool operator<(const layer_stack& other) const
+    {
+        auto key = [](const layer_stack& l)
+        {
+            return std::make_tuple(l.metal_base, l.albedo.x(), l.albedo.y(), l.albedo.z(), l.eta.x(), l.eta.y(), l.eta.z(),
+                                   l.k.x(), l.k.y(), l.k.z(), l.base_roughness, l.coat_ior);
+        };
+        return key(*this) < key(other);
+    }
+};
+
+class layered_table
+{
+/*
+ * precomputes the light that goes into a clear coat, bounces around between it and the base, and comes back out,
+ * by tracing random walks through the layers for every (coat roughness, cos_o). that's far too slow to do at every
+ * hit, but it's smooth enough to look up from a small table afterwards (the reflection off the top of the coat
+ * is sharp, so it stays an analytic lobe). the coat is infinitely thin and clear, the base is lambertian or
+ * a ggx conductor. tables are built once per distinct stack and shared, so materials that only differ in
+ * coat roughness use the same one. a build takes around a second, so it runs outside the lock:
+ * materials with other stacks carry on and only a material with the same stack waits for it
+ */
+public:
+    static constexpr int rough_size = 8; //coat roughness 0, 1/7, ..., 1
+    static constexpr int mu_size = 16;
+    static constexpr int metal_phi_size = 16; //light off a metal base keeps its direction, diffuse bases don't need azimuth
+    static constexpr int diffuse_paths = 4096; //random walks per (roughness, cos_o)
+    static constexpr int metal_paths = 8192;
+    static constexpr int max_bounces = 32;
+
+    static std::shared_ptr<const bsdf_table> get(const layer_stack& stack)
+    {
+        using table_future = std::shared_future<std::shared_ptr<const bsdf_table>>;
+        static std::mutex mutex;
+        static std::map<layer_stack, table_future> tables;
+
+        std::promise<std::shared_ptr<const bsdf_table>> promise;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            auto [it, added] = tables.try_emplace(stack);
+            if (!added)
+            {
+                table_future building = it->second;
+                lock.unlock();
+                return building.get();
+            }
+            it->second = promise.get_future().share();
+        }
+
+        try
+        {
+            auto table = std::make_shared<const bsdf_table>(build(stack));
+            promise.set_value(table);
+            return table;
+        }
+        catch (...)
+        {
+            promise.set_exception(std::current_exception());
+            throw;
+        }
+    }
+private:
+    static bsdf_table build(const layer_stack& stack)
+    {
+        int phi_size = stack.metal_base ? metal_phi_size : 1;
+        int paths = stack.metal_base ? metal_paths : diffuse_paths;
+        bsdf_table table(rough_size, mu_size, phi_size);
+        //builds of different stacks can run at once, so each has its own generator instead of random_double's
+        std::mt19937_64 generator(seed_of(stack));
+        std::uniform_real_distribution<double> uniform(0.0, 1.0);
+        auto rand = [&]{ return uniform(generator); };
+
+        //the base sits in the coat, so its fresnel is relative to the coat
+        double base_alpha = trowbridge_reitz::roughness_to_alpha(stack.base_roughness);
+        bxdf_lobe base = stack.metal_base
+            ? bxdf_lobe(microfacet_conductor(trowbridge_reitz(base_alpha, base_alpha), stack.eta / stack.coat_ior, stack.k / stack.coat_ior))
+            : bxdf_lobe(lambertian_reflection(stack.albedo));
+
+        for (int r = 0; r < rough_size; r++)
+        {
+            double alpha = trowbridge_reitz::roughness_to_alpha(table.roughness_at(r));
+            trowbridge_reitz distrib(alpha, alpha);
+            //the coat from outside, and from inside turned upside down so wo is always +z
+            bxdf_lobe enter = distrib.effectively_smooth() ? bxdf_lobe(fresnel_specular(1, stack.coat_ior))
+                                                            : bxdf_lobe(microfacet_dielectric(distrib, stack.coat_ior));
+            bxdf_lobe leave = distrib.effectively_smooth() ? bxdf_lobe(fresnel_specular(stack.coat_ior, 1))
+                                                            : bxdf_lobe(microfacet_dielectric(distrib, 1 / stack.coat_ior));
+            for (int o = 0; o < mu_size; o++)
+            {
+                double mu_o = table.cos_at(o);
+                vec3 wo(std::sqrt(1 - mu_o * mu_o), 0, mu_o);
+                for (int n = 0; n < paths; n++)
+                {
+                    vec3 wi;
+                    color weight = random_walk(wo, enter, leave, base, rand, wi);
+                    if (weight.near_zero()) continue;
+                    table.at(r, o, table.cos_bin(wi.z()), table.azimuth_bin(std::abs(std::atan2(wi.y(), wi.x())))) += weight;
+                }
+                //energy into a bin = f * integral of cos over the bin, both signs of phi
+                for (int i = 0; i < mu_size; i++)
+                {
+                    double lo = double(i) / mu_size, hi = double(i + 1) / mu_size;
+                    double projected = (hi * hi - lo * lo) / 2 * (2 * M_PI / phi_size);
+                    for (int p = 0; p < phi_size; p++) table.at(r, o, i, p) /= paths * projected;
+                }
+            }
+            //the real bsdf is reciprocal, averaging f(o, i) with f(i, o) halves the noise
+            for (int o = 0; o < mu_size; o++)
+            {
+                for (int i = o + 1; i < mu_size; i++)
+                {
+                    for (int p = 0; p < phi_size; p++)
+                    {
+                        color average = (table.at(r, o, i, p) + table.at(r, i, o, p)) / 2;
+                        table.at(r, o, i, p) = average;
+                        table.at(r, i, o, p) = average;
+                    }
+                }
+            }
+        }
+        table.finish();
+        return table;
+    }
+
+    static vec3 flip(const vec3& v) { return vec3(v.x(), v.y(), -v.z()); }
+
+    //the same stack always gets the same table
+    static std::uint64_t seed_of(const layer_stack& stack)
+    {
+        std::size_t seed = stack.metal_base ? 1 : 0;
+        hash_combine(seed, stack.albedo);
+        hash_combine(seed, stack.eta);
+        hash_combine(seed, stack.k);
+        hash_combine(seed, stack.base_roughness);
+        hash_combine(seed, stack.coat_ior);
+        return seed;
+    }
+
+    /*
+     * one path that refracts into the coat at wo and comes back out, weight is f * cos / pdf along the whole path.
+     * light reflected straight off the top is left out, the coat's own lobe covers it
+     */
+    template <typename Rand>
+    static color random_walk(const vec3& wo, const bxdf_lobe& enter, const bxdf_lobe& leave, const bxdf_lobe& base,
+                             Rand& rand, vec3& wi)
+    {
+        auto sample = [&](const bxdf_lobe& lobe, const vec3& w){ return visit_lobe(lobe, [&](const auto& b){ return b.sample(w, rand); }); };
+        auto weight_of = [](const bsdf_sample& s){ return s.f * std::abs(s.wi.z()) / s.pdf; };
+
+        bsdf_sample s = sample(enter, wo);
+        if (s.pdf == 0 || s.wi.z() >= 0) return color(0, 0, 0);
+        color throughput = weight_of(s);
+        vec3 down = s.wi; //travelling down through the coat
+
+        for (int bounce = 0; bounce < max_bounces; bounce++)
+        {
+            s = sample(base, -down);
+            if (s.pdf == 0 || s.wi.z() <= 0) return color(0, 0, 0);
+            throughput = throughput * weight_of(s);
+            vec3 up = s.wi;
+
+            //hitting the coat from below
+            s = sample(leave, flip(-up));
+            if (s.pdf == 0) return color(0, 0, 0);
+            throughput = throughput * weight_of(s);
+            vec3 out = flip(s.wi);
+            if (out.z() > 0)
+            {
+                wi = out;
+                return throughput;
+            }
+            down = out; //reflected back down
+
+            //russian roulette once the path has bounced a few times
+            if (bounce > 2)
+            {
+                double keep = std::min(1.0, double(std::max({throughput.x(), throughput.y(), throughput.z()})));
+                if (rand() >= keep) return color(0, 0, 0);
+                throughput = throughput / keep;
+            }
+        }
+        return color(0, 0, 0);
+    }
+};
+
+#endif //LAYERED_TABLE_H
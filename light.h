@@ -4,18 +4,26 @@
 
 #ifndef LIGHT_H
 #define LIGHT_H
+#include <optional>
+#include <vector>
+#include "alias_table.h"
 #include "color.h"
+#include "light_bounds.h"
 #include "material.h"
 #include "quad.h"
+#include "sphere.h"
+#include "triangle.h"
+#include "triangle_mesh.h"
 
 class light_sample{
 public:
     vec3 wi; //should be from shading point to light
     color emitted;
     double p_solid_angle = 0; //does NOT include the 1/(num_lights)
+    double distance = 0; //from the shading point to the sampled point, along wi (unit)
     light_sample() = default;
-    light_sample(const vec3& wi, const color& e, const double p) :
-    wi(wi), emitted(e), p_solid_angle(p){};
+    light_sample(const vec3& wi, const color& e, const double p, const double distance = 0) :
+    wi(wi), emitted(e), p_solid_angle(p), distance(distance){};
 };
 
 class light : hittable
@@ -33,40 +41,271 @@ public:
         //given the shading point, returns a light_sample w the info
         return light_sample();
     }
+    /**
+     * The solid angle pdf sample(x) would have had for a direction that hit the light, for MIS
+     * @param x the shading point the ray left from
+     * @param light_rec where the ray hit this light
+     */
+    virtual double pdf(const point3& x, const hit_record& light_rec) const
+    {
+        return 0;
+    }
+    //total light given off (luminance), lights are picked in proportion to it
+    virtual double power() const
+    {
+        return 0;
+    }
+    //where the light is and which way it shines, for bvh_light_sampler. nullopt if it's everywhere (ex: an environment)
+    virtual std::optional<light_bounds> bounds() const
+    {
+        return std::nullopt;
+    }
 };
 
-class quad_light : public light
+template <typename Shape>
+class planar_light : public light
 {
+/*
+ * a flat emitter (quad or triangle) shining to the side its normal faces.
+ * samples points uniformly by area and turns that into a pdf over solid angle at the shading point
+ */
 public:
-    quad_light(const shared_ptr<quad>& q, const shared_ptr<material>& mat) : q(q), mat(mat) {};
+    planar_light(const shared_ptr<Shape>& shape, const material& mat) : shape(shape), mat(&mat) {};
 
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override
     {
-        return q->hit(r, ray_t, rec);
+        return shape->hit(r, ray_t, rec);
     }
 
     aabb bounding_box() const override
     {
-        return q->bounding_box();
+        return shape->bounding_box();
     }
 
     light_sample sample(const vec3& x) const override
     {
-        vec3 y = q->get_random_point();
-        double p_a = 1.0/q->get_area();
+        vec3 y = shape->get_random_point();
+        double p_a = 1.0/shape->get_area();
         vec3 wi = unit_vector(y-x);
         //use -wi bc wi is from surface to light
-        double cos_theta_y = dot(-wi, q->n()); //shouldn't need to divide bc theyre both unit vectors
+        double cos_theta_y = dot(-wi, shape->n()); //shouldn't need to divide bc theyre both unit vectors
         if (cos_theta_y < 0)
         {
             //backface, no light should be reaching the point
             return light_sample(wi, color(0, 0, 0), 0);
         }
-        return light_sample(wi, mat->emitted(), p_a * (x-y).length_squared() / cos_theta_y);
+        return light_sample(wi, mat->emitted(), p_a * (x-y).length_squared() / cos_theta_y, (y-x).length());
+    }
+    double pdf(const point3& x, const hit_record& light_rec) const override
+    {
+        vec3 to_light = light_rec.p - x;
+        double cos_theta_y = dot(-unit_vector(to_light), shape->n());
+        if (cos_theta_y <= 0) return 0; //sample() never picks the back
+        return to_light.length_squared() / (cos_theta_y * shape->get_area());
+    }
+    double power() const override
+    {
+        //lambertian emitter, one sided: radiance * area * pi
+        return M_PI * shape->get_area() * luminance(mat->emitted());
+    }
+    std::optional<light_bounds> bounds() const override
+    {
+        //shines into the hemisphere around n
+        return light_bounds(shape->bounding_box(), shape->n(), power(), 1, 0, false);
+    }
+private:
+    shared_ptr<Shape> shape;
+    const material* mat; //owned by the scene's material_registry
+};
+
+using quad_light = planar_light<quad>;
+using triangle_light = planar_light<triangle>;
+
+class sphere_light : public light
+{
+/*
+ * a sphere shining outward. from outside it samples directions in the cone the sphere fills (pbrt-v4 6.2.4),
+ * so every sample hits the side facing the point and the pdf doesn't blow up for small or far spheres.
+ * points inside the sphere only see its back and get no samples
+ */
+public:
+    sphere_light(const point3& center, real radius, material_id mat_id, const material& mat) :
+    s(center, radius, mat_id), center(center), radius(radius), mat(&mat) {}
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    {
+        return s.hit(r, ray_t, rec);
+    }
+
+    aabb bounding_box() const override
+    {
+        return s.bounding_box();
+    }
+
+    light_sample sample(const vec3& x) const override
+    {
+        double one_minus_cos_max;
+        if (!cone(x, one_minus_cos_max)) return light_sample();
+
+        //cos theta uniform in [cos_max, 1] is uniform over the cone's solid angle
+        double dc = (center - x).length();
+        double cos_theta = 1 - random_double() * one_minus_cos_max;
+        double sin2_theta = std::max(0.0, 1 - cos_theta * cos_theta);
+        double phi = 2 * M_PI * random_double();
+        vec3 local(std::sqrt(sin2_theta) * std::cos(phi), std::sqrt(sin2_theta) * std::sin(phi), cos_theta);
+        vec3 wi = unit_vector(frame::from_z(unit_vector(center - x)).from_local(local));
+
+        //nearest of the two crossings along wi
+        double distance = dc * cos_theta - std::sqrt(std::max(0.0, double(radius) * radius - dc * dc * sin2_theta));
+        return light_sample(wi, mat->emitted(), 1 / (2 * M_PI * one_minus_cos_max), distance);
+    }
+    double pdf(const point3& x, const hit_record& light_rec) const override
+    {
+        double one_minus_cos_max;
+        if (!cone(x, one_minus_cos_max)) return 0;
+        return 1 / (2 * M_PI * one_minus_cos_max);
+    }
+    double power() const override
+    {
+        //lambertian everywhere on the surface: radiance * area * pi
+        return M_PI * 4 * M_PI * double(radius) * radius * luminance(mat->emitted());
+    }
+    std::optional<light_bounds> bounds() const override
+    {
+        //every direction, each point shines into its own hemisphere
+        return light_bounds(s.bounding_box(), vec3(0, 0, 1), power(), -1, 0, false);
     }
 private:
-    shared_ptr<quad> q;
-    shared_ptr<material> mat;
+    sphere s;
+    point3 center;
+    real radius;
+    const material* mat; //owned by the scene's material_registry
+
+    //1 - cos of the cone's half angle seen from x, false if x is inside the sphere
+    bool cone(const point3& x, double& one_minus_cos_max) const
+    {
+        double dc2 = (center - x).length_squared();
+        double r2 = double(radius) * radius;
+        if (dc2 <= r2) return false;
+        double sin2_max = r2 / dc2;
+        //1 - sqrt(1 - s) cancels for tiny cones, use its taylor series there
+        one_minus_cos_max = sin2_max < 1e-3 ? sin2_max / 2 + sin2_max * sin2_max / 8 : 1 - std::sqrt(1 - sin2_max);
+        return one_minus_cos_max > 0;
+    }
+};
+
+class mesh_light : public light
+{
+/*
+ * every triangle of one material slot of a mesh, as a single light. triangles are picked in proportion to their area
+ * with an alias table, then a point uniformly on it, so points are uniform over the whole emitting area.
+ * each triangle shines to the side its CCW normal faces
+ */
+public:
+    mesh_light(const shared_ptr<const triangle_mesh>& mesh, std::uint32_t slot, const material& mat) :
+    mesh(mesh), mat_id(mesh->slot_material(slot)), mat(&mat)
+    {
+        auto ranges = mesh->material_ranges();
+        std::vector<double> areas;
+        for (size_t r = 0; r < ranges.size(); r++)
+        {
+            if (ranges[r].slot != slot) continue;
+            std::uint32_t end = r + 1 < ranges.size() ? ranges[r + 1].first_triangle : std::uint32_t(mesh->num_triangles());
+            for (std::uint32_t tri = ranges[r].first_triangle; tri < end; tri++)
+            {
+                point3 p0, p1, p2;
+                mesh->triangle_positions(tri, p0, p1, p2);
+                double area = cross(p1 - p0, p2 - p0).length() / 2;
+                if (area <= 0) continue;
+                triangles.push_back(tri);
+                areas.push_back(area);
+                total_area += area;
+            }
+        }
+        table = alias_table(areas);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    {
+        return mesh->hit(r, ray_t, rec) && rec.mat == mat_id;
+    }
+
+    aabb bounding_box() const override
+    {
+        return mesh->bounding_box();
+    }
+
+    light_sample sample(const vec3& x) const override
+    {
+        double pmf;
+        int chosen = table.sample(random_double(), pmf);
+        if (chosen < 0) return light_sample();
+        point3 p0, p1, p2;
+        mesh->triangle_positions(triangles[chosen], p0, p1, p2);
+        point3 y = triangle::random_point(p0, p1, p2, random_double(), random_double());
+
+        vec3 wi = unit_vector(y - x);
+        double cos_theta_y = dot(-wi, unit_vector(cross(p1 - p0, p2 - p0)));
+        if (cos_theta_y <= 0) return light_sample(wi, color(0, 0, 0), 0);
+        //picking by area then uniformly on the triangle is uniform over the whole area
+        return light_sample(wi, mat->emitted(), (y - x).length_squared() / (cos_theta_y * total_area), (y - x).length());
+    }
+    double pdf(const point3& x, const hit_record& light_rec) const override
+    {
+        vec3 to_light = light_rec.p - x;
+        vec3 outward = light_rec.front_face ? light_rec.normal : -light_rec.normal;
+        double cos_theta_y = dot(-unit_vector(to_light), outward);
+        if (cos_theta_y <= 0) return 0;
+        return to_light.length_squared() / (cos_theta_y * total_area);
+    }
+    double power() const override
+    {
+        return M_PI * total_area * luminance(mat->emitted());
+    }
+    std::optional<light_bounds> bounds() const override
+    {
+        //every triangle's hemisphere, merged into one cone
+        light_bounds result;
+        for (std::uint32_t tri : triangles)
+        {
+            point3 p0, p1, p2;
+            mesh->triangle_positions(tri, p0, p1, p2);
+            vec3 n = cross(p1 - p0, p2 - p0);
+            double phi = M_PI * n.length() / 2 * luminance(mat->emitted());
+            result = light_bounds::merge(result, light_bounds(aabb(aabb(p0, p1), aabb(p1, p2)), n, phi, 1, 0, false));
+        }
+        return result;
+    }
+    bool empty() const { return triangles.empty(); }
+private:
+    shared_ptr<const triangle_mesh> mesh;
+    material_id mat_id;
+    const material* mat; //owned by the scene's material_registry
+    std::vector<std::uint32_t> triangles; //the slot's triangles with any area
+    alias_table table; //over triangles, by area
+    double total_area = 0;
+};
+
+//picks which light a shading point samples, in proportion to each light's power
+class power_light_sampler
+{
+public:
+    power_light_sampler() = default;
+    explicit power_light_sampler(const std::vector<shared_ptr<light>>& lights)
+    {
+        std::vector<double> powers;
+        powers.reserve(lights.size());
+        for (const auto& l : lights) powers.push_back(l->power());
+        table = alias_table(powers);
+    }
+
+    bool empty() const { return table.empty(); }
+    //index into the light list, or -1 if there are no lights. pmf is the chance it was picked
+    int sample(double u, double& pmf) const { return table.sample(u, pmf); }
+    //chance sample() picks light i, for MIS
+    double pmf(int i) const { return table.pmf(i); }
+private:
+    alias_table table;
 };
 
 #endif //LIGHT_H
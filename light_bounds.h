@@ -0,0 +1,147 @@
+//
+// Created by Faye Yu on 1/24/26.
+//
+
+#ifndef LIGHT_BOUNDS_H
+#define LIGHT_BOUNDS_H
+
+#include <algorithm>
+#include <cmath>
+#include "aabb.h"
+
+/*
+ * where a group of lights is, which way it shines and how much (Conty & Kulla 2018, pbrt-v4 12.6.3).
+ * light leaves within theta_o of w plus up to theta_e more around that (pi/2 for a lambertian emitter),
+ * so importance() can estimate how much of it reaches a point without looking at the lights themselves
+ */
+class light_bounds
+{
+public:
+    aabb bounds;
+    double phi = 0; //power
+    vec3 w = vec3(0, 0, 1);
+    double cos_theta_o = 1;
+    double cos_theta_e = 0;
+    bool two_sided = false;
+
+    light_bounds() = default;
+    light_bounds(const aabb& bounds, const vec3& w, double phi, double cos_theta_o, double cos_theta_e, bool two_sided) :
+    bounds(bounds), phi(phi), w(unit_vector(w)), cos_theta_o(cos_theta_o), cos_theta_e(cos_theta_e), two_sided(two_sided) {}
+
+    point3 centroid() const { return (bounds_min() + bounds_max()) / 2; }
+    point3 bounds_min() const { return point3(bounds.x.min, bounds.y.min, bounds.z.min); }
+    point3 bounds_max() const { return point3(bounds.x.max, bounds.y.max, bounds.z.max); }
+
+    /**
+     * Conservative estimate of the light arriving at p from everything in these bounds
+     * @param n the surface normal at p, or zero to leave out the cosine there (ex: the surface also transmits)
+     */
+    double importance(const point3& p, const vec3& n) const
+    {
+        //distance to the center, clamped so points inside the box don't blow up
+        point3 pc = centroid();
+        double d2 = (p - pc).length_squared();
+        d2 = std::max(d2, double((bounds_max() - bounds_min()).length()) / 2);
+
+        vec3 wi = unit_vector(p - pc);
+        double cos_theta_w = dot(w, wi);
+        if (two_sided) cos_theta_w = std::abs(cos_theta_w);
+        double sin_theta_w = safe_sqrt(1 - cos_theta_w * cos_theta_w);
+
+        //angle the box takes up seen from p
+        double cos_theta_b = bound_subtended_cos(p);
+        double sin_theta_b = safe_sqrt(1 - cos_theta_b * cos_theta_b);
+
+        //smallest angle between p and any direction the lights emit in, from anywhere in the box
+        double sin_theta_o = safe_sqrt(1 - cos_theta_o * cos_theta_o);
+        double cos_theta_x = cos_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        double sin_theta_x = sin_sub_clamped(sin_theta_w, cos_theta_w, sin_theta_o, cos_theta_o);
+        double cos_theta_p = cos_sub_clamped(sin_theta_x, cos_theta_x, sin_theta_b, cos_theta_b);
+        if (cos_theta_p <= cos_theta_e) return 0;
+
+        double importance = phi * cos_theta_p / d2;
+        if (n.length_squared() > 0)
+        {
+            //and the smallest angle to the surface normal
+            double cos_theta_i = std::abs(dot(wi, n));
+            double sin_theta_i = safe_sqrt(1 - cos_theta_i * cos_theta_i);
+            importance *= cos_sub_clamped(sin_theta_i, cos_theta_i, sin_theta_b, cos_theta_b);
+        }
+        return std::max(importance, 0.0);
+    }
+
+    //bounds around both, with a cone holding both cones
+    static light_bounds merge(const light_bounds& a, const light_bounds& b)
+    {
+        if (a.phi == 0) return b;
+        if (b.phi == 0) return a;
+        light_bounds result;
+        result.bounds = aabb(a.bounds, b.bounds);
+        result.phi = a.phi + b.phi;
+        merge_cones(a.w, a.cos_theta_o, b.w, b.cos_theta_o, result.w, result.cos_theta_o);
+        result.cos_theta_e = std::min(a.cos_theta_e, b.cos_theta_e);
+        result.two_sided = a.two_sided || b.two_sided;
+        return result;
+    }
+
+private:
+    static double safe_sqrt(double x) { return std::sqrt(std::max(0.0, x)); }
+    static double safe_acos(double x) { return std::acos(std::clamp(x, -1.0, 1.0)); }
+
+    //cos(max(0, theta_a - theta_b)) and sin of the same
+    static double cos_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b)
+    {
+        if (cos_a > cos_b) return 1;
+        return cos_a * cos_b + sin_a * sin_b;
+    }
+    static double sin_sub_clamped(double sin_a, double cos_a, double sin_b, double cos_b)
+    {
+        if (cos_a > cos_b) return 0;
+        return sin_a * cos_b - cos_a * sin_b;
+    }
+
+    //cos of the half angle of a cone from p holding the box's bounding sphere, -1 if p is inside it
+    double bound_subtended_cos(const point3& p) const
+    {
+        point3 center = centroid();
+        double radius2 = (bounds_max() - center).length_squared();
+        double dist2 = (p - center).length_squared();
+        if (dist2 < radius2) return -1;
+        return safe_sqrt(1 - radius2 / dist2);
+    }
+
+    //smallest cone (w, cos_theta) around two cones, pbrt-v4 3.8.4
+    static void merge_cones(const vec3& wa, double cos_a, const vec3& wb, double cos_b, vec3& w, double& cos_theta)
+    {
+        double theta_a = safe_acos(cos_a), theta_b = safe_acos(cos_b);
+        double theta_d = safe_acos(dot(wa, wb));
+        if (std::min(theta_d + theta_b, M_PI) <= theta_a)
+        {
+            w = wa;
+            cos_theta = cos_a;
+            return;
+        }
+        if (std::min(theta_d + theta_a, M_PI) <= theta_b)
+        {
+            w = wb;
+            cos_theta = cos_b;
+            return;
+        }
+        double theta_o = (theta_a + theta_d + theta_b) / 2;
+        vec3 axis = cross(wa, wb);
+        if (theta_o >= M_PI || axis.length_squared() == 0)
+        {
+            //every direction
+            w = wa;
+            cos_theta = -1;
+            return;
+        }
+        //rotate wa toward wb by theta_r (rodrigues)
+        double theta_r = theta_o - theta_a;
+        vec3 k = unit_vector(axis);
+        w = unit_vector(wa * std::cos(theta_r) + cross(k, wa) * std::sin(theta_r) + k * dot(k, wa) * (1 - std::cos(theta_r)));
+        cos_theta = std::cos(theta_o);
+    }
+};
+
+#endif //LIGHT_BOUNDS_H
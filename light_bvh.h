@@ -0,0 +1,286 @@
+//
+// Created by Faye Yu on 1/24/26.
+//
+
+#ifndef LIGHT_BVH_H
+#define LIGHT_BVH_H
+
+#include <bit>
+#include <cassert>
+#include <cstdint>
+#include <vector>
+#include "light.h"
+
+class bvh_light_sampler
+{
+/*
+ * picks a light for a shading point by walking down a tree of light_bounds, at every node going left or right
+ * in proportion to how much light each side could send to the point (pbrt-v4 12.6.3). near, bright lights
+ * facing the point get picked most and lights facing away never, in O(log n) for any number of lights.
+ * every light remembers its path from the root as bits, so pmf() can redo the walk for MIS.
+ * lights without bounds() get picked uniformly before the tree, lights with no power never
+ */
+public:
+    bvh_light_sampler() = default;
+    explicit bvh_light_sampler(const std::vector<shared_ptr<light>>& lights) : trails(lights.size(), not_in_tree)
+    {
+        std::vector<std::pair<int, light_bounds>> bounded;
+        for (size_t i = 0; i < lights.size(); i++)
+        {
+            std::optional<light_bounds> b = lights[i]->bounds();
+            if (!b)
+            {
+                unbounded.push_back(int(i));
+                trails[i] = unbounded_trail;
+            }
+            else if (b->phi > 0) bounded.emplace_back(int(i), *b);
+        }
+        if (!bounded.empty()) build(bounded, 0, bounded.size(), 0, 0);
+    }
+
+    bool empty() const { return nodes.empty() && unbounded.empty(); }
+
+    /**
+     * @param p the shading point
+     * @param n its normal, or zero if light from behind counts too (ex: it transmits)
+     * @param u uniform in [0, 1)
+     * @param pmf set to the chance the returned light was picked
+     * @return index into the light list, or -1 if no light can reach p
+     */
+    int sample(const point3& p, const vec3& n, double u, double& pmf) const
+    {
+        pmf = 0;
+        double p_unbounded = unbounded_chance();
+        if (u < p_unbounded)
+        {
+            u /= p_unbounded;
+            int i = std::min(int(u * unbounded.size()), int(unbounded.size()) - 1);
+            pmf = p_unbounded / unbounded.size();
+            return unbounded[i];
+        }
+        if (nodes.empty()) return -1;
+        u = std::min((u - p_unbounded) / (1 - p_unbounded), one_minus_epsilon);
+
+        double result = 1 - p_unbounded;
+        int node_index = 0;
+        while (true)
+        {
+            const node& nd = nodes[node_index];
+            if (nd.is_leaf)
+            {
+                //a single light at the root wasn't checked on the way down
+                if (node_index > 0 || nd.bounds.importance(p, n) > 0)
+                {
+                    pmf = result;
+                    return nd.index;
+                }
+                return -1;
+            }
+            double left = nodes[node_index + 1].bounds.importance(p, n);
+            double right = nodes[nd.index].bounds.importance(p, n);
+            if (left == 0 && right == 0) return -1;
+            //pick a side and stretch u back over [0, 1) for the next level
+            double p_left = left / (left + right);
+            if (u < p_left)
+            {
+                u = std::min(u / p_left, one_minus_epsilon);
+                result *= p_left;
+                node_index = node_index + 1;
+            }
+            else
+            {
+                u = std::min((u - p_left) / (1 - p_left), one_minus_epsilon);
+                result *= 1 - p_left;
+                node_index = nd.index;
+            }
+        }
+    }
+
+    //the chance sample(p, n, ...) returns light i
+    double pmf(const point3& p, const vec3& n, int i) const
+    {
+        if (trails[i] == unbounded_trail) return unbounded_chance() / unbounded.size();
+        if (trails[i] == not_in_tree) return 0;
+
+        std::uint64_t trail = trails[i];
+        double result = 1 - unbounded_chance();
+        int node_index = 0;
+        while (true)
+        {
+            const node& nd = nodes[node_index];
+            if (nd.is_leaf)
+            {
+                //same check as sample(), a single light at the root wasn't weighed on the way down
+                return node_index > 0 || nd.bounds.importance(p, n) > 0 ? result : 0;
+            }
+            double left = nodes[node_index + 1].bounds.importance(p, n);
+            double right = nodes[nd.index].bounds.importance(p, n);
+            if (left == 0 && right == 0) return 0;
+            bool go_right = trail & 1;
+            result *= (go_right ? right : left) / (left + right);
+            node_index = go_right ? nd.index : node_index + 1;
+            trail >>= 1;
+        }
+    }
+
+    //calls fn(light index) for every light in the tree whose bounds hold p (ex: which light a ray just hit)
+    template <typename Fn>
+    void for_each_light_at(const point3& p, Fn&& fn) const
+    {
+        for (int i : unbounded) fn(i);
+        if (nodes.empty()) return;
+        int stack[max_leaf_depth + 1]; //a node's unvisited siblings on the way down, plus its own two children
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0)
+        {
+            const node& nd = nodes[stack[--top]];
+            if (!contains(nd.bounds.bounds, p)) continue;
+            if (nd.is_leaf)
+            {
+                fn(nd.index);
+                continue;
+            }
+            stack[top++] = int(&nd - nodes.data()) + 1;
+            stack[top++] = nd.index;
+        }
+    }
+private:
+    struct node
+    {
+        light_bounds bounds;
+        int index = 0; //the second child, or the light for a leaf. the first child is always the next node
+        bool is_leaf = false;
+    };
+    std::vector<node> nodes;
+    std::vector<int> unbounded;
+    std::vector<std::uint64_t> trails; //per light: bit k set = went right at depth k
+    static constexpr std::uint64_t not_in_tree = ~std::uint64_t(0);
+    static constexpr std::uint64_t unbounded_trail = ~std::uint64_t(0) - 1;
+    static constexpr double one_minus_epsilon = 1 - 1e-12;
+    static constexpr int buckets = 12;
+    //no leaf is deeper than this, so a trail fits in 64 bits and for_each_light_at's stack can't overflow
+    static constexpr int max_leaf_depth = 63;
+
+    double unbounded_chance() const
+    {
+        if (unbounded.empty()) return 0;
+        return double(unbounded.size()) / (unbounded.size() + (nodes.empty() ? 0 : 1));
+    }
+
+    static bool contains(const aabb& b, const point3& p)
+    {
+        //a little slack, hit points land just off the surface
+        double e = 1e-4 * (1 + std::max({std::abs(p.x()), std::abs(p.y()), std::abs(p.z())}));
+        return p.x() >= b.x.min - e && p.x() <= b.x.max + e && p.y() >= b.y.min - e && p.y() <= b.y.max + e
+            && p.z() >= b.z.min - e && p.z() <= b.z.max + e;
+    }
+
+    //how good a node of these bounds is to have, lower is better (pbrt-v4's surface area orientation heuristic)
+    static double cost(const light_bounds& b, const aabb& node_box, int axis)
+    {
+        double theta_o = std::acos(std::clamp(b.cos_theta_o, -1.0, 1.0));
+        double theta_e = std::acos(std::clamp(b.cos_theta_e, -1.0, 1.0));
+        double theta_w = std::min(theta_o + theta_e, M_PI);
+        double sin_theta_o = std::sqrt(std::max(0.0, 1 - b.cos_theta_o * b.cos_theta_o));
+        double m_omega = 2 * M_PI * (1 - b.cos_theta_o)
+                       + M_PI / 2 * (2 * theta_w * sin_theta_o - std::cos(theta_o - 2 * theta_w)
+                                     - 2 * theta_o * sin_theta_o + b.cos_theta_o);
+        //long thin nodes split across their short side are worse
+        double extent[3] = {node_box.x.size(), node_box.y.size(), node_box.z.size()};
+        double kr = std::max({extent[0], extent[1], extent[2]}) / std::max(extent[axis], 1e-12);
+        double dx = b.bounds.x.size(), dy = b.bounds.y.size(), dz = b.bounds.z.size();
+        double area = 2 * (dx * dy + dy * dz + dz * dx);
+        return b.phi * m_omega * kr * area;
+    }
+
+    //builds nodes for lights [start, end) and returns the bounds of all of them
+    light_bounds build(std::vector<std::pair<int, light_bounds>>& lights, size_t start, size_t end,
+                       std::uint64_t trail, int depth)
+    {
+        assert(depth <= max_leaf_depth);
+        if (end - start == 1)
+        {
+            node leaf;
+            leaf.bounds = lights[start].second;
+            leaf.index = lights[start].first;
+            leaf.is_leaf = true;
+            nodes.push_back(leaf);
+            trails[lights[start].first] = trail;
+            return leaf.bounds;
+        }
+
+        aabb box, centroids;
+        for (size_t i = start; i < end; i++)
+        {
+            box = aabb(box, lights[i].second.bounds);
+            point3 c = lights[i].second.centroid();
+            centroids = aabb(centroids, aabb(c, c));
+        }
+
+        //best bucket boundary over every axis. SAH splits can be lopsided, so only use them while even a split
+        //leaving all but one light on a side can still finish with count splits within max_leaf_depth
+        double best_cost = infinity;
+        int best_axis = -1, best_bucket = -1;
+        if (depth + 1 + int(std::bit_width(end - start - 1)) <= max_leaf_depth)
+        {
+            for (int axis = 0; axis < 3; axis++)
+            {
+                const auto& range = centroids.axis_interval(axis);
+                if (range.size() <= 0) continue;
+
+                light_bounds bucket_bounds[buckets];
+                for (size_t i = start; i < end; i++)
+                {
+                    int b = bucket_of(lights[i].second.centroid()[axis], range.min, range.size());
+                    bucket_bounds[b] = light_bounds::merge(bucket_bounds[b], lights[i].second);
+                }
+                for (int split = 0; split < buckets - 1; split++)
+                {
+                    light_bounds below, above;
+                    for (int b = 0; b <= split; b++) below = light_bounds::merge(below, bucket_bounds[b]);
+                    for (int b = split + 1; b < buckets; b++) above = light_bounds::merge(above, bucket_bounds[b]);
+                    double c = cost(below, box, axis) + cost(above, box, axis);
+                    if (c > 0 && c < best_cost)
+                    {
+                        best_cost = c;
+                        best_axis = axis;
+                        best_bucket = split;
+                    }
+                }
+            }
+        }
+
+        size_t mid;
+        if (best_axis == -1)
+        {
+            //every centroid in one spot (or close to max_leaf_depth), split by count
+            mid = (start + end) / 2;
+        }
+        else
+        {
+            const auto& range = centroids.axis_interval(best_axis);
+            auto first = lights.begin() + start, last = lights.begin() + end;
+            mid = std::partition(first, last, [&](const auto& l)
+            {
+                return bucket_of(l.second.centroid()[best_axis], range.min, range.size()) <= best_bucket;
+            }) - lights.begin();
+            if (mid == start || mid == end) mid = (start + end) / 2;
+        }
+
+        size_t node_index = nodes.size();
+        nodes.emplace_back();
+        light_bounds left = build(lights, start, mid, trail, depth + 1);
+        nodes[node_index].index = int(nodes.size());
+        light_bounds right = build(lights, mid, end, trail | (std::uint64_t(1) << depth), depth + 1);
+        nodes[node_index].bounds = light_bounds::merge(left, right);
+        return nodes[node_index].bounds;
+    }
+
+    static int bucket_of(double v, double min, double size)
+    {
+        return std::clamp(int(buckets * (v - min) / size), 0, buckets - 1);
+    }
+};
+
+#endif //LIGHT_BVH_H
@@ -1,56 +1,66 @@
 #include <chrono>
 #include "rtweekend.h"
 
+#include "box.h"
 #include "bvh_node.h"
 #include "camera.h"
 #include "hittable_list.h"
 #include "light.h"
+#include "material_registry.h"
 #include "obj_loader.h"
 #include "sphere.h"
+#include "sphere_set.h"
 #include "quad.h"
+#include "triangle.h"
+#include "transform.h"
 
 void make_big_scene()
 {
     hittable_list world;
+    material_registry materials;
 
-    auto ground_material = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    auto ground_material = materials.add<lambertian>(color(0.5, 0.5, 0.5));
     world.add(make_shared<sphere>(point3(0,-1000,0), 1000, ground_material));
 
+    //the small spheres go in one sphere_set instead of one sphere object each
+    auto particles = make_shared<sphere_set>();
     for (int a = -11; a < 11; a++) {
         for (int b = -11; b < 11; b++) {
             auto choose_mat = random_double();
             point3 center(a + 0.9*random_double(), 0.2, b + 0.9*random_double());
 
             if ((center - point3(4, 0.2, 0)).length() > 0.9) {
-                shared_ptr<material> sphere_material;
+                material_id sphere_material;
 
                 if (choose_mat < 0.8) {
                     // diffuse
                     auto albedo = color::random() * color::random();
-                    sphere_material = make_shared<lambertian>(albedo);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = materials.add<lambertian>(albedo);
+                    particles->add(center, 0.2, sphere_material);
                 } else if (choose_mat < 0.95) {
                     // metal
                     auto albedo = color::random(0.5, 1);
                     auto fuzz = random_double(0, 0.5);
-                    sphere_material = make_shared<metal>(albedo, fuzz);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = materials.add<metal>(albedo, fuzz);
+                    particles->add(center, 0.2, sphere_material);
                 } else {
                     // glass
-                    sphere_material = make_shared<dielectric>(1.5);
-                    world.add(make_shared<sphere>(center, 0.2, sphere_material));
+                    sphere_material = materials.add<dielectric>(1.5);
+                    particles->add(center, 0.2, sphere_material);
                 }
             }
         }
     }
+    particles->build();
+    world.add(particles);
 
-    auto material1 = make_shared<dielectric>(1.5);
+    auto material1 = materials.add<dielectric>(1.5);
     world.add(make_shared<sphere>(point3(0, 1, 0), 1.0, material1));
 
-    auto material2 = make_shared<lambertian>(color(0.4, 0.2, 0.1));
+    auto material2 = materials.add<lambertian>(color(0.4, 0.2, 0.1));
     world.add(make_shared<sphere>(point3(-4, 1, 0), 1.0, material2));
 
-    auto material3 = make_shared<metal>(color(0.7, 0.6, 0.5), 0.0);
+    auto material3 = materials.add<metal>(color(0.7, 0.6, 0.5), 0.0);
     world.add(make_shared<sphere>(point3(4, 1, 0), 1.0, material3));
 
     world = hittable_list(make_shared<bvh_node>(world));
@@ -71,18 +81,19 @@ void make_big_scene()
     cam.defocus_angle = 0.6;
     cam.focus_dist    = 10.0;
 
-    cam.render(world); //camera will call initialize() at beginning of render()
+    cam.render(world, materials); //camera will call initialize() at beginning of render()
 }
 void make_small_test_scene()
 {
     hittable_list world;
+    material_registry materials;
 
-    auto material_ground = make_shared<lambertian>(color(0.8, 0.8, 0.0));
-    auto material_center = make_shared<lambertian>(color(0.1, 0.2, 0.5));
-    //auto material_left = make_shared<metal>(color(0.8, 0.8, 0.8), 0.3);
-    auto material_left = make_shared<dielectric>(1.50);
-    auto material_bubble = make_shared<dielectric>(1.00 / 1.50);
-    auto material_right = make_shared<metal>(color(0.8, 0.6, 0.2), 1.0);
+    auto material_ground = materials.add<lambertian>(color(0.8, 0.8, 0.0));
+    auto material_center = materials.add<lambertian>(color(0.1, 0.2, 0.5));
+    //auto material_left = materials.add<metal>(color(0.8, 0.8, 0.8), 0.3);
+    auto material_left = materials.add<dielectric>(1.50);
+    auto material_bubble = materials.add<dielectric>(1.00 / 1.50);
+    auto material_right = materials.add<metal>(color(0.8, 0.6, 0.2), 1.0);
 
     //ground
     world.add(make_shared<sphere>(point3(0.0, -100.5, -1.0), 100.0, material_ground));
@@ -109,19 +120,20 @@ void make_small_test_scene()
     cam.defocus_angle = 10.0;
     cam.focus_dist    = 3.4;
 
-    cam.render(world);
+    cam.render(world, materials);
 }
 void quads()
 {
     hittable_list world;
+    material_registry materials;
 
     //materials
-    auto left_red = make_shared<lambertian>(color(1.0, 0.2, 0.2));
-    auto back_green = make_shared<lambertian>(color(0.2, 1.0, 0.2));
-    auto right_blue = make_shared<lambertian>(color(0.2, 0.2, 1.0));
-    auto upper_orange = make_shared<lambertian>(color(1.0, 0.5, 0.0));
-    auto lower_teal = make_shared<lambertian>(color(0.2, 0.8, 0.8));
-    auto glass_ball = make_shared<dielectric>(1.5);
+    auto left_red = materials.add<lambertian>(color(1.0, 0.2, 0.2));
+    auto back_green = materials.add<lambertian>(color(0.2, 1.0, 0.2));
+    auto right_blue = materials.add<lambertian>(color(0.2, 0.2, 1.0));
+    auto upper_orange = materials.add<lambertian>(color(1.0, 0.5, 0.0));
+    auto lower_teal = materials.add<lambertian>(color(0.2, 0.8, 0.8));
+    auto glass_ball = materials.add<dielectric>(1.5);
 
     //quads
     world.add(make_shared<quad>(point3(-3, -2, 5), vec3(0, 0, -4), vec3(0, 4, 0), left_red));
@@ -146,25 +158,22 @@ void quads()
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    cam.render(world, materials);
 }
 void load_obj()
 {
     hittable_list world;
+    material_registry materials;
 
     obj_loader loader = obj_loader("/Users/fayeyu/CLionProjects/raytracing/objs");
-    /*auto mat = make_shared<lambertian>(color(1.0, 0.0, 0.0));
+    /*auto mat = materials.add<lambertian>(color(1.0, 0.0, 0.0));
     world.add(make_shared<sphere>(point3(0, 2, 0), 1, mat));*/
 
-    auto mat1 = make_shared<lambertian>(color(1.0, 0.2, 0.5));
+    auto mat1 = materials.add<lambertian>(color(1.0, 0.2, 0.5));
     shared_ptr<triangle_mesh> mesh1 = loader.load("cube_and_sphere.obj", mat1);
 
-    //world.add(mesh1);
-
-    aabb bb = mesh1->bounding_box();
-
-    hittable_list tris = mesh1->triangles;
-    world.add(make_shared<bvh_node>(tris));
+    //the mesh builds its own bvh over its triangles
+    world.add(mesh1);
 
     camera cam;
 
@@ -182,14 +191,15 @@ void load_obj()
     cam.defocus_angle = 0.0;
     cam.focus_dist    = 3;
 
-    cam.render(world);
+    cam.render(world, materials);
 
-    std::clog << "triangles: " << tris.objects.size() << std::endl;
+    std::clog << "triangles: " << mesh1->num_triangles() << std::endl;
 }
 void triangle_test(){
     hittable_list world;
+    material_registry materials;
 
-    auto mat1 = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    auto mat1 = materials.add<lambertian>(color(0.5, 0.5, 0.5));
     world.add(make_shared<triangle>(vec3(0, 0, -1), vec3(1, 0, -1), vec3(0, 1, -1), mat1));
     //world.add(make_shared<sphere>(vec3(0, 0, -1), 0.5, mat1));
 
@@ -209,18 +219,19 @@ void triangle_test(){
     cam.defocus_angle = 0.0;
     cam.focus_dist    = 3;
 
-    cam.render(world);
+    cam.render(world, materials);
 }
 void simple_light()
 {
     hittable_list world;
+    material_registry materials;
 
-    auto ground_mat = make_shared<lambertian>(color(0.5, 0.5, 0.5));
+    auto ground_mat = materials.add<lambertian>(color(0.5, 0.5, 0.5));
     world.add(make_shared<sphere>(point3(0, -1000, 0), 1000, ground_mat));
     world.add(make_shared<sphere>(point3(0, 2, 0), 2, ground_mat));
 
     auto intensity = 8;
-    auto difflight = make_shared<diffuse_light>(8*color(1.0, 0, 0.5), color(1.0, 1.0, 1.0));
+    auto difflight = materials.add<diffuse_light>(8*color(1.0, 0, 0.5), color(1.0, 1.0, 1.0));
     world.add(make_shared<quad>(point3(3, 1, -2), vec3(2, 0, 0), vec3(0, 2, 0), difflight));
 
     camera cam;
@@ -238,44 +249,42 @@ void simple_light()
 
     cam.defocus_angle = 0;
 
-    cam.render(world);
+    cam.render(world, materials);
 }
 void cornell_box() {
     hittable_list world;
-    std::vector<shared_ptr<light>> lights;
+    material_registry materials;
 
-    auto red   = make_shared<lambertian>(color(.65, .05, .05));
-    auto white = make_shared<lambertian>(color(.73, .73, .73));
-    auto green = make_shared<lambertian>(color(.12, .45, .15));
-    auto light_mat = make_shared<diffuse_light>(color(15, 15, 15), color(1.0, 1.0, 1.0));
-    auto metal_mat = make_shared<metal>(color(0.75, 0.75, 0.75), 0);
-    auto glass = make_shared<dielectric>(1.5);
+    auto red   = materials.add<lambertian>(color(.65, .05, .05));
+    auto white = materials.add<lambertian>(color(.73, .73, .73));
+    auto green = materials.add<lambertian>(color(.12, .45, .15));
+    auto light_mat = materials.add<diffuse_light>(color(15, 15, 15), color(1.0, 1.0, 1.0));
+    [[maybe_unused]] auto metal_mat = materials.add<metal>(color(0.75, 0.75, 0.75), 0);
+    [[maybe_unused]] auto glass = materials.add<dielectric>(1.5);
 
     world.add(make_shared<quad>(point3(555,0,0), vec3(0,555,0), vec3(0,0,555), green));
     world.add(make_shared<quad>(point3(0,0,0), vec3(0,555,0), vec3(0,0,555), red));
-    auto l = make_shared<quad>(point3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105), light_mat);
-    world.add(l);
-    lights.push_back(make_shared<quad_light>(l, light_mat));
+    world.add(make_shared<quad>(point3(343, 554, 332), vec3(-130,0,0), vec3(0,0,-105), light_mat)); //found as a light by render()
     world.add(make_shared<quad>(point3(0,0,0), vec3(555,0,0), vec3(0,0,555), white));
     world.add(make_shared<quad>(point3(555,555,555), vec3(-555,0,0), vec3(0,0,-555), white));
     world.add(make_shared<quad>(point3(0,0,555), vec3(555,0,0), vec3(0,555,0), white));
 
-    shared_ptr<hittable> bigger_box = box(point3(0,0,0), point3(165,330,165), white);
-    bigger_box = make_shared<rotate_y>(bigger_box, -15);
-    bigger_box = make_shared<translate>(bigger_box, vec3(130,0,295)); //265
+    shared_ptr<hittable> bigger_box = make_shared<box>(point3(0,0,0), point3(165,330,165), white);
+    bigger_box = rotate_y(bigger_box, -15);
+    bigger_box = translate(bigger_box, vec3(130,0,295)); //265, collapses into the rotate_y transform
     world.add(bigger_box);
 
-    shared_ptr<hittable> smaller_box = box(point3(0,0,0), point3(165,165,165), white);
-    smaller_box = make_shared<rotate_y>(smaller_box, 18);
-    smaller_box = make_shared<translate>(smaller_box, vec3( 265,0,65)); //130
+    shared_ptr<hittable> smaller_box = make_shared<box>(point3(0,0,0), point3(165,165,165), white);
+    smaller_box = rotate_y(smaller_box, 18);
+    smaller_box = translate(smaller_box, vec3( 265,0,65)); //130
     world.add(smaller_box);
 
     //world.add(make_shared<sphere>(point3(300, 300, 300), 70, metal_mat));
     //world.add(make_shared<sphere>(point3(450, 300, 300), 70, glass));
 
-    /*shared_ptr<hittable> test_box = box(point3(0, 0, 0), point3(200, 200, 200), white);
-    test_box = make_shared<translate>(test_box, vec3(100, 0, 300));
-    test_box = make_shared<rotate_y>(test_box, 45);
+    /*shared_ptr<hittable> test_box = make_shared<box>(point3(0, 0, 0), point3(200, 200, 200), white);
+    test_box = translate(test_box, vec3(100, 0, 300));
+    test_box = rotate_y(test_box, 45);
     world.add(test_box);*/
 
     world = hittable_list(make_shared<bvh_node>(world));
@@ -296,7 +305,7 @@ void cornell_box() {
 
     cam.defocus_angle = 0;
 
-    cam.render(world, lights);
+    cam.render(world, materials);
 }
 // TIP To <b>Run</b> code, press <shortcut actionId="Run"/> or click the <icon src="AllIcons.Actions.Execute"/> icon in the gutter.
 int main() {
@@ -0,0 +1,99 @@
+//
+// Created by Faye Yu on 1/13/26.
+//
+
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <fstream>
+#include <iostream>
+#include <span>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+//no mmap here, the file is read into memory instead so everything still works, just not out of core
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+class mapped_file
+{
+/*
+ * read only view of a whole file. with mmap nothing is read up front, the OS pages data in when it's touched
+ * and can drop clean pages again under memory pressure, so files bigger than RAM still work (just slower)
+ */
+public:
+    /**
+     * @param path
+     * @param random_access hint that reads will jump around (ex: bvh traversal) so the OS shouldn't read ahead
+     */
+    explicit mapped_file(const std::string& path, bool random_access = false)
+    {
+#if defined(_WIN32)
+        std::ifstream in(path, std::ios::binary | std::ios::ate);
+        if (!in)
+        {
+            std::clog << "Could not open " << path << std::endl;
+            return;
+        }
+        buffer.resize(static_cast<size_t>(in.tellg()));
+        in.seekg(0);
+        in.read(reinterpret_cast<char*>(buffer.data()), static_cast<std::streamsize>(buffer.size()));
+        bytes = buffer.data();
+        length = buffer.size();
+#else
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+        {
+            std::clog << "Could not open " << path << std::endl;
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
+        {
+            void* p = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                bytes = static_cast<const std::byte*>(p);
+                length = static_cast<size_t>(info.st_size);
+                if (random_access) madvise(p, length, MADV_RANDOM);
+            }
+            else std::clog << "Could not map " << path << std::endl;
+        }
+        close(fd); //the mapping stays valid without the descriptor
+#endif
+    }
+    ~mapped_file()
+    {
+#if !defined(_WIN32)
+        if (bytes) munmap(const_cast<std::byte*>(bytes), length);
+#endif
+    }
+    mapped_file(const mapped_file&) = delete;
+    mapped_file& operator=(const mapped_file&) = delete;
+
+    bool is_open() const { return bytes != nullptr; }
+    const std::byte* data() const { return bytes; }
+    size_t size() const { return length; }
+
+    //count Ts starting offset bytes into the file, empty if that runs past the end
+    template <typename T>
+    std::span<const T> view(size_t offset, size_t count) const
+    {
+        if (offset > length || count > (length - offset) / sizeof(T)) return {};
+        return std::span<const T>(reinterpret_cast<const T*>(bytes + offset), count);
+    }
+private:
+    const std::byte* bytes = nullptr;
+    size_t length = 0;
+#if defined(_WIN32)
+    std::vector<std::byte> buffer;
+#endif
+};
+
+#endif //MAPPED_FILE_H
@@ -5,9 +5,11 @@
 #ifndef MATERIAL_H
 #define MATERIAL_H
 
+#include <typeinfo>
 #include "color.h"
 #include "hittable.h"
 #include "bxdf.h"
+#include "layered_table.h"
 
 class material
 {
@@ -20,14 +22,25 @@ public:
     {
         return false;
     }
-    virtual bsdf create_bsdf(const hit_record& rec) const
+    //the bsdf's lobes go in arena, so it's only good until the arena is reset
+    virtual bsdf create_bsdf(const hit_record& rec, memory_arena& arena) const
     {
-        return bsdf{rec};
+        return bsdf{rec, arena};
     }
     virtual color emitted() const
     {
         return color(0, 0, 0); //default emit is black
     }
+    //used by material_registry to de-duplicate materials with identical parameters
+    //by default a material is only equal to itself
+    virtual bool equals(const material& other) const
+    {
+        return this == &other;
+    }
+    virtual std::size_t hash() const
+    {
+        return std::hash<const material*>{}(this);
+    }
 };
 
 class lambertian : public material
@@ -56,12 +69,23 @@ public:
         return true;
     }
 
-    bsdf create_bsdf(const hit_record& rec) const override
+    bsdf create_bsdf(const hit_record& rec, memory_arena& arena) const override
     {
-        bsdf b = bsdf{rec};
+        bsdf b = bsdf{rec, arena};
         b.add<lambertian_reflection>(albedo);
         return b;
     }
+    bool equals(const material& other) const override
+    {
+        if (typeid(other) != typeid(*this)) return false;
+        return albedo == static_cast<const lambertian&>(other).albedo;
+    }
+    std::size_t hash() const override
+    {
+        std::size_t seed = typeid(*this).hash_code();
+        hash_combine(seed, albedo);
+        return seed;
+    }
 private:
     color albedo;
 };
@@ -69,7 +93,18 @@ private:
 class metal : public material
 {
 public:
-    metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1){}
+    //fuzz works as the ggx roughness, the fresnel is made to reflect albedo head on
+    metal(const color& albedo, double fuzz) : albedo(albedo), fuzz(fuzz < 1 ? fuzz : 1)
+    {
+        fresnel_conductor::from_reflectivity(albedo, eta, k);
+    }
+    /**
+     * @param eta real part of the metal's complex ior, per rgb channel (ex: gold ~ (0.18, 0.42, 1.37))
+     * @param k imaginary part, how strongly it absorbs (ex: gold ~ (3.42, 2.35, 1.77))
+     * @param roughness 0 is a perfect mirror, 1 is very rough
+     */
+    metal(const color& eta, const color& k, double roughness) :
+    albedo(fresnel_conductor::reflectance(1, eta, k)), fuzz(std::clamp(roughness, 0.0, 1.0)), eta(eta), k(k) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override
     {
@@ -82,28 +117,40 @@ public:
         //if ray 'scattered' is pointed inside surface then discard
         return (dot(scattered.direction(), rec.normal) > 0);
     }
-    static double Fr_conductor(double cos_theta_i, double eta_i, double eta_t, double k_t){
-        /*double eta = eta_t / eta_i;
-        double k = k_t / eta_i;
-
-        double cos_squared = cos_theta_i * cos_theta_i;
-        double ab_temp = eta*eta - k*k - (1-cos_squared);
-        double a2_b2 = sqrt(ab_temp * ab_temp + 4 * eta * eta * k * k);
-
-        double r_perp = a2_b2 - 2 *
-        */
-        return 1.0;
+    bsdf create_bsdf(const hit_record& rec, memory_arena& arena) const override
+    {
+        bsdf b = bsdf{rec, arena};
+        double alpha = trowbridge_reitz::roughness_to_alpha(fuzz);
+        b.add<microfacet_conductor>(trowbridge_reitz(alpha, alpha), eta, k);
+        return b;
+    }
+    bool equals(const material& other) const override
+    {
+        if (typeid(other) != typeid(*this)) return false;
+        const auto& o = static_cast<const metal&>(other);
+        return eta == o.eta && k == o.k && fuzz == o.fuzz;
+    }
+    std::size_t hash() const override
+    {
+        std::size_t seed = typeid(*this).hash_code();
+        hash_combine(seed, eta);
+        hash_combine(seed, k);
+        hash_combine(seed, fuzz);
+        return seed;
     }
 
 private:
-    color albedo;
+    color albedo; //reflectance head on
     double fuzz;
+    color eta, k;
 };
 
 class dielectric : public material
 {
 public:
-    dielectric(double refraction_index) : refraction_index(refraction_index) {}
+    //roughness > 0 makes frosted glass
+    dielectric(double refraction_index, double roughness = 0) :
+    refraction_index(refraction_index), roughness(std::clamp(roughness, 0.0, 1.0)) {}
 
     bool scatter(const ray& r_in, const hit_record& rec, color& attenuation, ray& scattered) const override
     {
@@ -138,46 +185,42 @@ public:
         //out of say, glass into air it should be reset to 1 with creation of new way
         return true;
     }
-    color f_s(const vec3& wo, const vec3& wi, const hit_record& rec) const
-    {
-        return color(0,0,0); //nothing scatters in any direction except the one light reflects in
-    }
-    double pdf(const vec3& wo, const vec3& wi, const hit_record& rec) const
-    {
-        return 0.0; //we don't use a pdf for speculars bc there's only one correct direction we can calculate
-    }
-    bsdf_sample sample(const vec3& wo, const hit_record& rec) const
+    bsdf create_bsdf(const hit_record& rec, memory_arena& arena) const override
     {
-        //assume smooth for this, can add microfacets in the gpu version hehe
-        vec3 unit_direction = unit_vector(wo);
-        //theta is angle between incoming ray and normal
-        double cos_theta = std::fmin(dot(-unit_direction, rec.normal), 1.0);
-        cos_theta = std::abs(cos_theta);
-
-        //need to find eta_i of medium ray is currently in, eta_t is known
-        double eta_i = rec.incident_eta;
+        bsdf b = bsdf{rec, arena};
+        //like scatter, entering through a front face and leaving back into air through a back face
+        double eta_i = rec.front_face ? rec.incident_eta : refraction_index;
         double eta_t = rec.front_face ? refraction_index : 1.0;
-        double reflectance = Fr_dielectric(cos_theta, eta_i, eta_t);
-        vec3 wi;
-        if (random_double() < reflectance) //reflect
+        double alpha = trowbridge_reitz::roughness_to_alpha(roughness);
+        trowbridge_reitz distrib(alpha, alpha);
+        if (distrib.effectively_smooth())
         {
-            wi = reflect(unit_direction, rec.normal);
-            double f_s = reflectance / cos_theta;
-            //assuming clear glass aka attenuation = all 1
-            return bsdf_sample(wi, color(1.0, 1.0, 1.0) * f_s, 1, true);
-        }else //refract
+            b.add<fresnel_specular>(eta_i, eta_t);
+        }
+        else
         {
-            wi = refract(unit_direction, rec.normal, eta_i/eta_t);
-            //TODO somehow update the ior of the ray
-            double f_s = (1-reflectance) / cos_theta;
-            return bsdf_sample(wi, color(1.0, 1.0, 1.0) * f_s, 1, true);
-
+            b.add<microfacet_dielectric>(distrib, eta_t / eta_i);
         }
+        return b;
+    }
+    bool equals(const material& other) const override
+    {
+        if (typeid(other) != typeid(*this)) return false;
+        const auto& o = static_cast<const dielectric&>(other);
+        return refraction_index == o.refraction_index && roughness == o.roughness;
+    }
+    std::size_t hash() const override
+    {
+        std::size_t seed = typeid(*this).hash_code();
+        hash_combine(seed, refraction_index);
+        hash_combine(seed, roughness);
+        return seed;
     }
 private:
     //refractive index in vacuum or air, or the ratio of the material's refractive index
     //over the refractive index of the enclosing media
     double refraction_index;
+    double roughness;
 
     static double schlick_reflectance(double cosine, double refraction_index)
     {
@@ -187,36 +230,78 @@ private:
         r0 = r0 * r0;
         return r0 + (1-r0)*std::pow((1-cosine), 5);
     }
+};
 
-    //eta_i : index of refraction for incident material
-    //eta_t : index of refraction for transmitted material
-    //returns how much light is reflected (0 = none, 1 = all)
-    static double Fr_dielectric(double cos_theta_i, double eta_i, double eta_t)
+//a clear coat over a diffuse or metal base (ex: car paint, varnished wood). see layered_table for how it's evaluated
+class layered : public material
+{
+public:
+    /**
+     * Clear coat over a lambertian base
+     * @param albedo the base's diffuse color
+     * @param coat_ior
+     * @param coat_roughness 0 is a glossy smooth coat, 1 is very rough
+     */
+    layered(const color& albedo, double coat_ior, double coat_roughness)
     {
-        if (cos_theta_i < 0)
-        {
-            //the ray is on the inside, swap the etas
-            double temp = eta_i;
-            eta_i = eta_t;
-            eta_t = temp;
-            cos_theta_i = std::abs(cos_theta_i); //ensure cos_theta_i is nonneg
-        }
-
-        //find cos_theta_t using snell's law
-        double sin_theta_i = std::sqrt(std::max(static_cast<double>(0), 1 - cos_theta_i * cos_theta_i));
-        double sin_theta_t = eta_i * sin_theta_i / eta_t;
-        if (sin_theta_t >= 1)
-        {
-            return 1; //no solution for snell's law, all light reflected
-        }
-        double cos_theta_t = std::sqrt(std::max(static_cast<double>(0), 1 - sin_theta_t * sin_theta_t));
+        stack.albedo = albedo;
+        stack.coat_ior = coat_ior;
+        init(coat_roughness);
+    }
+    /**
+     * Clear coat over a metal base
+     * @param eta @param k the metal's complex ior, see metal
+     * @param base_roughness the metal's own roughness under the coat
+     * @param coat_ior
+     * @param coat_roughness
+     */
+    layered(const color& eta, const color& k, double base_roughness, double coat_ior, double coat_roughness)
+    {
+        stack.metal_base = true;
+        stack.eta = eta;
+        stack.k = k;
+        stack.base_roughness = std::clamp(base_roughness, 0.0, 1.0);
+        stack.coat_ior = coat_ior;
+        init(coat_roughness);
+    }
 
-        double r_parallel = (eta_t * cos_theta_i - eta_i * cos_theta_t)
-        / (eta_t * cos_theta_i + eta_i * cos_theta_t);
-        double r_perp = (eta_i * cos_theta_i - eta_t * cos_theta_t)
-        / (eta_i * cos_theta_i + eta_t * cos_theta_t);
+    bsdf create_bsdf(const hit_record& rec, memory_arena& arena) const override
+    {
+        bsdf b = bsdf{rec, arena};
+        double alpha = trowbridge_reitz::roughness_to_alpha(coat_roughness);
+        b.add<dielectric_reflection>(trowbridge_reitz(alpha, alpha), stack.coat_ior);
+        b.add<tabulated_reflection>(table.get(), coat_roughness);
+        return b;
+    }
+    bool equals(const material& other) const override
+    {
+        if (typeid(other) != typeid(*this)) return false;
+        const auto& o = static_cast<const layered&>(other);
+        return !(stack < o.stack) && !(o.stack < stack) && coat_roughness == o.coat_roughness;
+    }
+    std::size_t hash() const override
+    {
+        std::size_t seed = typeid(*this).hash_code();
+        hash_combine(seed, stack.albedo);
+        hash_combine(seed, stack.eta);
+        hash_combine(seed, stack.k);
+        hash_combine(seed, stack.base_roughness);
+        hash_combine(seed, stack.coat_ior);
+        hash_combine(seed, coat_roughness);
+        return seed;
+    }
+private:
+    layer_stack stack;
+    double coat_roughness = 0;
+    std::shared_ptr<const bsdf_table> table; //shared with every layered material with the same stack
 
-        return (r_parallel * r_parallel + r_perp * r_perp) / 2;
+    void init(double roughness)
+    {
+        coat_roughness = std::clamp(roughness, 0.0, 1.0);
+        //the coat's reflection lobe snaps to a mirror below alpha ~1e-3, match the table's smooth row
+        double alpha = trowbridge_reitz::roughness_to_alpha(coat_roughness);
+        if (trowbridge_reitz(alpha, alpha).effectively_smooth()) coat_roughness = 0;
+        table = layered_table::get(stack);
     }
 };
 
@@ -230,6 +315,17 @@ public:
     {
         return emit;
     }
+    bool equals(const material& other) const override
+    {
+        //lambertian::equals checks the type and albedo
+        return lambertian::equals(other) && emit == static_cast<const diffuse_light&>(other).emit;
+    }
+    std::size_t hash() const override
+    {
+        std::size_t seed = lambertian::hash();
+        hash_combine(seed, emit);
+        return seed;
+    }
 private:
     color emit;
 };
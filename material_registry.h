@@ -0,0 +1,55 @@
+//
+// Created by Faye Yu on 1/6/26.
+//
+
+#ifndef MATERIAL_REGISTRY_H
+#define MATERIAL_REGISTRY_H
+
+#include <unordered_map>
+#include <vector>
+#include "material.h"
+
+class material_registry
+{
+/*
+ * the scene owns every material here, and primitives only keep a material_id.
+ * hit_record carries the id too, so accepting a hit never touches a refcount
+ */
+public:
+    material_registry() = default;
+    //materials are referenced by id and by address (ex: lights), so don't copy the registry around
+    material_registry(const material_registry&) = delete;
+    material_registry& operator=(const material_registry&) = delete;
+
+    /**
+     * Construct a material in place and register it
+     * @return the id of the new material, or of an already registered material with identical parameters
+     */
+    template <typename T, typename... Args>
+    material_id add(Args&&... args)
+    {
+        return add(std::make_unique<T>(std::forward<Args>(args)...));
+    }
+    material_id add(std::unique_ptr<material> mat)
+    {
+        std::size_t h = mat->hash();
+        auto [first, last] = lookup.equal_range(h);
+        for (auto it = first; it != last; ++it)
+        {
+            if (materials[it->second]->equals(*mat)) return it->second; //de-duplicate
+        }
+        auto id = static_cast<material_id>(materials.size());
+        materials.push_back(std::move(mat));
+        lookup.emplace(h, id);
+        return id;
+    }
+
+    const material& operator[](material_id id) const { return *materials[id]; }
+    size_t size() const { return materials.size(); }
+private:
+    //unique_ptrs so material addresses stay stable as the vector grows
+    std::vector<std::unique_ptr<material>> materials;
+    std::unordered_multimap<std::size_t, material_id> lookup; //hash -> ids with that hash
+};
+
+#endif //MATERIAL_REGISTRY_H
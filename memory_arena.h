@@ -0,0 +1,81 @@
+//
+// Created by Faye Yu on 1/19/26.
+//
+
+#ifndef MEMORY_ARENA_H
+#define MEMORY_ARENA_H
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <utility>
+#include <vector>
+
+class memory_arena
+{
+/*
+ * bump allocator for short lived objects (ex: a path vertex's bsdf lobes). allocating is moving an offset,
+ * and reset() frees everything at once by moving it back, keeping the blocks for next time,
+ * so once it's warmed up nothing touches the heap. each thread uses its own arena, there's no locking.
+ * destructors are never run, so only put objects in here that don't own anything
+ */
+public:
+    explicit memory_arena(size_t block_size = 64 * 1024) : block_size(block_size) {}
+    memory_arena(const memory_arena&) = delete;
+    memory_arena& operator=(const memory_arena&) = delete;
+
+    void* allocate(size_t bytes, size_t alignment = alignof(std::max_align_t))
+    {
+        while (true)
+        {
+            if (current < blocks.size())
+            {
+                //blocks come from new[], aligned for anything up to max_align_t
+                size_t start = (offset + alignment - 1) / alignment * alignment;
+                if (start + bytes <= blocks[current].size)
+                {
+                    offset = start + bytes;
+                    return blocks[current].data.get() + start;
+                }
+                //doesn't fit, move on to the next block
+                current++;
+                offset = 0;
+                continue;
+            }
+            blocks.push_back({std::make_unique<std::byte[]>(std::max(bytes, block_size)), std::max(bytes, block_size)});
+        }
+    }
+
+    template <typename T, typename... Args>
+    T* make(Args&&... args)
+    {
+        static_assert(alignof(T) <= alignof(std::max_align_t));
+        return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    //everything allocated so far is gone
+    void reset()
+    {
+        current = 0;
+        offset = 0;
+    }
+
+    size_t bytes_reserved() const
+    {
+        size_t total = 0;
+        for (const block& b : blocks) total += b.size;
+        return total;
+    }
+private:
+    struct block
+    {
+        std::unique_ptr<std::byte[]> data;
+        size_t size;
+    };
+    std::vector<block> blocks;
+    size_t current = 0; //block being allocated from
+    size_t offset = 0; //bytes used in it
+    size_t block_size;
+};
+
+#endif //MEMORY_ARENA_H
@@ -0,0 +1,376 @@
+//
+// Created by Faye Yu on 1/13/26.
+//
+
+#ifndef MESH_FILE_H
+#define MESH_FILE_H
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <type_traits>
+#include "triangle_mesh.h"
+
+class mesh_file
+{
+/*
+ * binary file holding a triangle_mesh's arrays and its bvh nodes exactly as they are laid out in memory,
+ * each section starting on a 4KB page. loading maps the file and points the mesh's spans into it,
+ * so nothing is parsed or built and the OS only reads in the pages rays actually touch.
+ * that's what lets a scene bigger than RAM render (slower as it pages) instead of running out of memory.
+ * files are in the host's byte order and only load in a build with the same real type.
+ * when used as a cache of another file (ex: obj_loader's .rtmesh next to each obj) the header records
+ * what it was built from, so the owner can tell if it's stale.
+ * loading only checks the header and that every section is inside the file, anything more would read in
+ * the whole file before the first ray. the header keeps a checksum of the sections for load(..., verify)
+ */
+public:
+    static constexpr std::uint32_t version = 4;
+    static constexpr size_t page_size = 4096;
+
+    //identifies the source a mesh file was built from, and how
+    struct source_key
+    {
+        std::uint64_t settings = 0; //build options, ex: quantize
+        std::uint64_t size = 0; //source size in bytes
+        std::int64_t modified = 0; //source modification time, in the filesystem's clock ticks
+        std::uint64_t hash = 0; //hash of the source contents, from hash_bytes
+    };
+
+    //what the mesh's material slots were called in its source. material ids belong to a registry and can't be stored,
+    //so the loader matches slots up with materials again by name
+    struct slot_names
+    {
+        std::vector<std::string> libraries; //ex: the obj's mtllib files
+        std::vector<std::string> slots; //one per material slot
+    };
+
+    /**
+     * @param mesh
+     * @param path where to write, replaced if it exists
+     * @param key what the mesh was built from, if it's a cache of another file
+     * @return if the whole file was written
+     */
+    static bool write(const triangle_mesh& mesh, const std::string& path, const source_key& key,
+                      const slot_names& names = slot_names())
+    {
+        //write next to it and rename at the end, so a reader never maps a half written file
+        //and a mesh still mapped from the old file keeps working
+        std::string temp_path = path + ".tmp";
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        if (!out)
+        {
+            std::clog << "Could not write " << path << std::endl;
+            return false;
+        }
+
+        header h = {};
+        std::memcpy(h.magic, magic, sizeof(magic));
+        h.version = version;
+        h.real_size = sizeof(real);
+        h.num_slots = static_cast<std::uint32_t>(mesh.num_material_slots());
+        h.key = key;
+        h.quantized = mesh.quantized ? 1 : 0;
+        h.position_codec = mesh.position_codec;
+        h.uv_codec = mesh.uv_codec;
+        h.tree_depth = mesh.bvh.tree_depth();
+        //header goes first, it gets rewritten once the section offsets are known
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+
+        h.nodes = write_section(out, mesh.bvh.nodes(), h.checksum);
+        h.indices = write_section(out, mesh.indices, h.checksum);
+        h.positions = write_section(out, mesh.positions, h.checksum);
+        h.normals = write_section(out, mesh.normals, h.checksum);
+        h.uvs = write_section(out, mesh.uvs, h.checksum);
+        h.packed_positions = write_section(out, mesh.packed_positions, h.checksum);
+        h.packed_normals = write_section(out, mesh.packed_normals, h.checksum);
+        h.packed_uvs = write_section(out, mesh.packed_uvs, h.checksum);
+        h.ranges = write_section(out, mesh.ranges, h.checksum);
+        std::string libraries = join(names.libraries);
+        std::string slots = join(names.slots);
+        h.libraries = write_section(out, std::span<const char>(libraries), h.checksum);
+        h.slot_names = write_section(out, std::span<const char>(slots), h.checksum);
+
+        out.seekp(0);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.close();
+#if defined(_WIN32)
+        std::remove(path.c_str()); //rename won't replace an existing file here
+#endif
+        if (!out || std::rename(temp_path.c_str(), path.c_str()) != 0)
+        {
+            std::clog << "Failed writing " << path << std::endl;
+            std::remove(temp_path.c_str());
+            return false;
+        }
+        return true;
+    }
+
+    static bool write(const triangle_mesh& mesh, const std::string& path)
+    {
+        return write(mesh, path, source_key());
+    }
+
+    /**
+     * Reads just the header, to check a cache before mapping all of it
+     * @return the key the file was written with, or nothing if it isn't a mesh file this build can load
+     */
+    static std::optional<source_key> read_key(const std::string& path)
+    {
+        std::ifstream in(path, std::ios::binary);
+        header h;
+        if (!in.read(reinterpret_cast<char*>(&h), sizeof(h)) || !compatible(h)) return std::nullopt;
+        return h.key;
+    }
+
+    //64 bit FNV-1a over 8 byte words (and the leftover bytes), fast enough to run over multi GB sources
+    static std::uint64_t hash_bytes(std::span<const std::byte> bytes)
+    {
+        constexpr std::uint64_t prime = 0x100000001b3;
+        std::uint64_t h = 0xcbf29ce484222325;
+        size_t i = 0;
+        for (; i + 8 <= bytes.size(); i += 8)
+        {
+            std::uint64_t word;
+            std::memcpy(&word, bytes.data() + i, 8);
+            h = (h ^ word) * prime;
+        }
+        for (; i < bytes.size(); i++) h = (h ^ static_cast<std::uint64_t>(bytes[i])) * prime;
+        return h ^ bytes.size();
+    }
+
+    /**
+     * @param path a file made by write()
+     * @param mat the material every slot starts out with
+     * @param names if not null, gets the slot names the file was written with
+     * @param verify also read the whole file to check its checksum, every index and every bvh node.
+     * without it only the header and the section sizes are checked, and the sections are paged in as rays need them
+     * @return the mesh backed by the mapped file, or nullptr if the file can't be used
+     */
+    static shared_ptr<triangle_mesh> load(const std::string& path, material_id mat, slot_names* names = nullptr,
+                                          bool verify = false)
+    {
+        auto file = make_shared<mapped_file>(path, true);
+        if (!file->is_open()) return nullptr;
+
+        header h;
+        if (file->size() < sizeof(h))
+        {
+            std::clog << path << " is too small to be a mesh file, returning nullptr" << std::endl;
+            return nullptr;
+        }
+        std::memcpy(&h, file->data(), sizeof(h));
+        if (!compatible(h))
+        {
+            std::clog << path << " is not a mesh file for this version/build, returning nullptr" << std::endl;
+            return nullptr;
+        }
+
+        //private constructor, so no make_shared
+        auto mesh = shared_ptr<triangle_mesh>(new triangle_mesh());
+        mesh->slot_materials.assign(std::max<std::uint32_t>(h.num_slots, 1), mat);
+        mesh->quantized = h.quantized != 0;
+        mesh->position_codec = h.position_codec;
+        mesh->uv_codec = h.uv_codec;
+        bool ok = map_section(*file, h.indices, mesh->indices)
+               && map_section(*file, h.positions, mesh->positions)
+               && map_section(*file, h.normals, mesh->normals)
+               && map_section(*file, h.uvs, mesh->uvs)
+               && map_section(*file, h.packed_positions, mesh->packed_positions)
+               && map_section(*file, h.packed_normals, mesh->packed_normals)
+               && map_section(*file, h.packed_uvs, mesh->packed_uvs)
+               && map_section(*file, h.ranges, mesh->ranges);
+        std::span<const flat_bvh_node> nodes;
+        std::span<const char> libraries, slots;
+        ok = ok && map_section(*file, h.nodes, nodes)
+                && map_section(*file, h.libraries, libraries)
+                && map_section(*file, h.slot_names, slots);
+        if (!ok || !consistent(*mesh, nodes, h.tree_depth))
+        {
+            std::clog << path << " is truncated or corrupt, returning nullptr" << std::endl;
+            return nullptr;
+        }
+        if (verify)
+        {
+            std::uint64_t checksum = 0;
+            add_to_checksum(checksum, nodes);
+            add_to_checksum(checksum, mesh->indices);
+            add_to_checksum(checksum, mesh->positions);
+            add_to_checksum(checksum, mesh->normals);
+            add_to_checksum(checksum, mesh->uvs);
+            add_to_checksum(checksum, mesh->packed_positions);
+            add_to_checksum(checksum, mesh->packed_normals);
+            add_to_checksum(checksum, mesh->packed_uvs);
+            add_to_checksum(checksum, mesh->ranges);
+            add_to_checksum(checksum, libraries);
+            add_to_checksum(checksum, slots);
+            std::uint32_t depth = 0;
+            if (checksum != h.checksum || !indices_in_range(*mesh) || !check_nodes(nodes, mesh->num_triangles(), depth)
+                || depth != h.tree_depth)
+            {
+                std::clog << path << " failed verification, returning nullptr" << std::endl;
+                return nullptr;
+            }
+        }
+        mesh->bvh.attach(nodes, h.tree_depth);
+        mesh->file = std::move(file);
+        if (names)
+        {
+            names->libraries = split(libraries);
+            names->slots = split(slots);
+        }
+        return mesh;
+    }
+private:
+    static constexpr char magic[8] = {'R', 'T', 'M', 'E', 'S', 'H', 0, 0};
+
+    struct section
+    {
+        std::uint64_t offset; //bytes from the start of the file
+        std::uint64_t count; //number of elements
+    };
+    struct header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t real_size; //sizeof(real) in the build that wrote it
+        std::uint32_t quantized;
+        std::uint32_t num_slots;
+        source_key key;
+        section nodes, indices, positions, normals, uvs, packed_positions, packed_normals, packed_uvs;
+        section ranges, libraries, slot_names; //the names are '\0' terminated strings back to back
+        position_quantizer position_codec;
+        uv_quantizer uv_codec;
+        std::uint32_t tree_depth; //flat_bvh::tree_depth() of the nodes
+        std::uint64_t checksum; //over the sections in the order they're written, see add_to_checksum
+    };
+    static_assert(std::is_trivially_copyable_v<header>);
+
+    /*
+     * the array sizes fit together and the ranges (a handful of entries) are valid. only reads the header
+     * and the ranges section, the indices and nodes are trusted unless load() is asked to verify them
+     */
+    static bool consistent(const triangle_mesh& mesh, std::span<const flat_bvh_node> nodes, std::uint32_t tree_depth)
+    {
+        size_t num_vertices = mesh.num_vertices();
+        size_t num_triangles = mesh.num_triangles();
+        if (mesh.indices.size() % 3 != 0) return false;
+        if (mesh.quantized ? !mesh.positions.empty() : !mesh.packed_positions.empty()) return false;
+        size_t normals = mesh.quantized ? mesh.packed_normals.size() : mesh.normals.size();
+        size_t uvs = mesh.quantized ? mesh.packed_uvs.size() : mesh.uvs.size();
+        if ((normals != 0 && normals != num_vertices) || (uvs != 0 && uvs != num_vertices)) return false;
+        if (nodes.empty() ? num_triangles != 0 || tree_depth != 0 : tree_depth == 0 || tree_depth > nodes.size()) return false;
+
+        //ranges start at triangle 0, go up, and name slots that exist
+        if (mesh.ranges.empty() || mesh.ranges[0].first_triangle != 0) return false;
+        for (size_t r = 0; r < mesh.ranges.size(); r++)
+        {
+            if (mesh.ranges[r].slot >= mesh.slot_materials.size()) return false;
+            if (mesh.ranges[r].first_triangle > num_triangles) return false;
+            if (r > 0 && mesh.ranges[r].first_triangle < mesh.ranges[r - 1].first_triangle) return false;
+        }
+        return true;
+    }
+
+    static bool indices_in_range(const triangle_mesh& mesh)
+    {
+        size_t num_vertices = mesh.num_vertices();
+        return std::none_of(mesh.indices.begin(), mesh.indices.end(), [&](std::uint32_t i){ return i >= num_vertices; });
+    }
+
+    /*
+     * walks the tree once: every child index is inside the array and reached only once (so there are no cycles),
+     * and every leaf's triangles exist. depth gets the tree's depth for flat_bvh::attach
+     */
+    static bool check_nodes(std::span<const flat_bvh_node> nodes, size_t num_triangles, std::uint32_t& depth)
+    {
+        depth = 0;
+        if (nodes.empty()) return num_triangles == 0;
+        std::vector<bool> reached(nodes.size(), false);
+        reached[0] = true;
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> pending = {{0, 1}}; //(node, its depth)
+        while (!pending.empty())
+        {
+            auto [i, d] = pending.back();
+            pending.pop_back();
+            depth = std::max(depth, d);
+            const flat_bvh_node& node = nodes[i];
+            if (node.count > 0)
+            {
+                if (size_t(node.offset) + node.count > num_triangles) return false;
+                continue;
+            }
+            if (size_t(node.offset) + 1 >= nodes.size() || node.axis > 2) return false;
+            for (std::uint32_t child = node.offset; child < node.offset + 2; child++)
+            {
+                if (reached[child]) return false;
+                reached[child] = true;
+                pending.emplace_back(child, d + 1);
+            }
+        }
+        return true;
+    }
+
+    static bool compatible(const header& h)
+    {
+        return std::memcmp(h.magic, magic, sizeof(magic)) == 0 && h.version == version && h.real_size == sizeof(real);
+    }
+
+    template <typename T>
+    static void add_to_checksum(std::uint64_t& checksum, std::span<const T> data)
+    {
+        checksum = (checksum ^ hash_bytes(std::as_bytes(data))) * 0x100000001b3;
+    }
+
+    template <typename T>
+    static section write_section(std::ofstream& out, std::span<const T> data, std::uint64_t& checksum)
+    {
+        add_to_checksum(checksum, data);
+        //pad up to the next page so the section is page aligned once mapped
+        auto pos = static_cast<size_t>(out.tellp());
+        size_t aligned = (pos + page_size - 1) / page_size * page_size;
+        static const char zeros[page_size] = {};
+        out.write(zeros, static_cast<std::streamsize>(aligned - pos));
+
+        out.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(data.size_bytes()));
+        return {aligned, data.size()};
+    }
+
+    static std::string join(const std::vector<std::string>& strings)
+    {
+        std::string joined;
+        for (const std::string& s : strings)
+        {
+            joined += s;
+            joined += '\0';
+        }
+        return joined;
+    }
+    static std::vector<std::string> split(std::span<const char> joined)
+    {
+        std::vector<std::string> strings;
+        std::string current;
+        for (char c : joined)
+        {
+            if (c != '\0')
+            {
+                current += c;
+                continue;
+            }
+            strings.push_back(current);
+            current.clear();
+        }
+        return strings;
+    }
+
+    template <typename T>
+    static bool map_section(const mapped_file& file, const section& s, std::span<const T>& view)
+    {
+        view = file.view<T>(s.offset, s.count);
+        return view.size() == s.count;
+    }
+};
+
+#endif //MESH_FILE_H
@@ -0,0 +1,248 @@
+//
+// Created by Faye Yu on 1/21/26.
+//
+
+#ifndef MICROFACET_H
+#define MICROFACET_H
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+#include "fresnel.h"
+
+//trig on directions in a bxdf's local space, where the normal is +z
+inline double cos_theta(const vec3& w) { return w.z(); }
+inline double cos2_theta(const vec3& w) { return w.z() * w.z(); }
+inline double sin2_theta(const vec3& w) { return std::max(0.0, 1 - cos2_theta(w)); }
+inline double tan2_theta(const vec3& w) { return sin2_theta(w) / cos2_theta(w); }
+inline double cos_phi(const vec3& w)
+{
+    double sin_theta = std::sqrt(sin2_theta(w));
+    return sin_theta == 0 ? 1 : std::clamp(w.x() / sin_theta, -1.0, 1.0);
+}
+inline double sin_phi(const vec3& w)
+{
+    double sin_theta = std::sqrt(sin2_theta(w));
+    return sin_theta == 0 ? 0 : std::clamp(w.y() / sin_theta, -1.0, 1.0);
+}
+inline bool same_hemisphere(const vec3& w, const vec3& wp) { return w.z() * wp.z() > 0; }
+
+//the trowbridge-reitz (ggx) distribution of microfacet normals, pbrt 9.6
+class trowbridge_reitz
+{
+public:
+    trowbridge_reitz() = default;
+    trowbridge_reitz(double alpha_x, double alpha_y) : alpha_x(alpha_x), alpha_y(alpha_y)
+    {
+        //tiny alphas blow up D(), those surfaces get treated as perfectly smooth instead
+        if (!effectively_smooth())
+        {
+            this->alpha_x = std::max(alpha_x, 1e-4);
+            this->alpha_y = std::max(alpha_y, 1e-4);
+        }
+    }
+
+    //roughness is perceptually linear in [0, 1], alpha = roughness^2
+    static double roughness_to_alpha(double roughness) { return roughness * roughness; }
+
+    bool effectively_smooth() const { return std::max(alpha_x, alpha_y) < 1e-3; }
+    double alpha() const { return std::sqrt(alpha_x * alpha_y); }
+
+    //density of microfacets with normal wm
+    double D(const vec3& wm) const
+    {
+        double tan2 = tan2_theta(wm);
+        if (std::isinf(tan2)) return 0;
+        double cos4 = cos2_theta(wm) * cos2_theta(wm);
+        if (cos4 < 1e-16) return 0;
+        double cp = cos_phi(wm), sp = sin_phi(wm);
+        double e = tan2 * (cp * cp / (alpha_x * alpha_x) + sp * sp / (alpha_y * alpha_y));
+        return 1 / (M_PI * alpha_x * alpha_y * cos4 * (1 + e) * (1 + e));
+    }
+    //masked microfacet area per visible microfacet area in direction w
+    double lambda(const vec3& w) const
+    {
+        double tan2 = tan2_theta(w);
+        if (std::isinf(tan2)) return 0;
+        double cp = cos_phi(w), sp = sin_phi(w);
+        double alpha2 = cp * cp * alpha_x * alpha_x + sp * sp * alpha_y * alpha_y;
+        return (std::sqrt(1 + alpha2 * tan2) - 1) / 2;
+    }
+    //fraction of microfacets visible from w
+    double G1(const vec3& w) const { return 1 / (1 + lambda(w)); }
+    //fraction visible from both wo and wi (height correlated)
+    double G(const vec3& wo, const vec3& wi) const { return 1 / (1 + lambda(wo) + lambda(wi)); }
+    //density of microfacet normals seen from w, what sample_wm() draws from
+    double D(const vec3& w, const vec3& wm) const
+    {
+        return G1(w) / std::abs(cos_theta(w)) * D(wm) * std::abs(dot(w, wm));
+    }
+    double pdf(const vec3& w, const vec3& wm) const { return D(w, wm); }
+
+    /*
+     * samples a microfacet normal visible from w (Heitz 2018, "Sampling the GGX Distribution of Visible Normals").
+     * only facets that can actually be seen get picked, so far fewer samples are wasted than sampling D() alone
+     */
+    vec3 sample_wm(const vec3& w, double u1, double u2) const
+    {
+        //stretch w so the distribution becomes a hemisphere
+        vec3 wh = unit_vector(vec3(alpha_x * w.x(), alpha_y * w.y(), w.z()));
+        if (wh.z() < 0) wh = -wh;
+
+        //basis around wh
+        vec3 t1 = (wh.z() < 0.99999) ? unit_vector(cross(vec3(0, 0, 1), wh)) : vec3(1, 0, 0);
+        vec3 t2 = cross(wh, t1);
+
+        //uniform point on a disk, squished toward the part of the hemisphere w can see
+        double r = std::sqrt(u1);
+        double phi = 2 * M_PI * u2;
+        double px = r * std::cos(phi), py = r * std::sin(phi);
+        double h = std::sqrt(1 - px * px);
+        double s = (1 + wh.z()) / 2;
+        py = (1 - s) * h + s * py;
+
+        //project up onto the hemisphere and unstretch
+        double pz = std::sqrt(std::max(0.0, 1 - px * px - py * py));
+        vec3 nh = px * t1 + py * t2 + pz * wh;
+        return unit_vector(vec3(alpha_x * nh.x(), alpha_y * nh.y(), std::max(1e-6, double(nh.z()))));
+    }
+private:
+    double alpha_x = 0, alpha_y = 0;
+};
+
+class microfacet_albedo
+{
+/*
+ * single scattering ggx loses the light that bounces between microfacets more than once, so rough surfaces come out
+ * too dark. these tables hold E, the fraction that does get out after one bounce, for each view angle and roughness
+ * (and relative ior for dielectrics). a lobe scales itself by about 1/E to put the missing light back
+ * (Turquin 2019, "Practical multiple scattering compensation for microfacet models").
+ * built once on first use by integrating with stratified visible normal samples, no random numbers involved
+ */
+public:
+    static constexpr int mu_size = 32; //cos of the view angle, (0, 1]
+    static constexpr int alpha_size = 32; //alpha, (0, 1]
+    static constexpr int eta_size = 16; //relative ior, log spaced over [1/max_eta, max_eta]
+    static constexpr double max_eta = 3.0;
+
+    //E(mu, alpha) for a reflector with fresnel = 1
+    static double conductor(double mu, double alpha)
+    {
+        static const microfacet_albedo table = build_conductor();
+        return table.lookup(mu, alpha, 0);
+    }
+    //E(mu, alpha, eta) for a dielectric, reflected + refracted. eta is the ior across the boundary over the ior on wo's side
+    static double dielectric(double mu, double alpha, double eta)
+    {
+        static const microfacet_albedo table = build_dielectric();
+        double x = std::clamp(std::log(eta) / std::log(max_eta), -1.0, 1.0);
+        return table.lookup(mu, alpha, (x + 1) / 2 * (eta_size - 1));
+    }
+private:
+    int num_eta = 1;
+    std::vector<float> values; //[eta][alpha][mu]
+
+    //strata x strata samples per entry, the dielectric table has 16x the entries so it gets fewer
+    static constexpr int conductor_strata = 16;
+    static constexpr int dielectric_strata = 8;
+
+    //cells are sampled at their centers, lookups clamp to the outermost ones
+    static double grid_to_value(int i, int size) { return (i + 0.5) / size; }
+    static double value_to_grid(double v, int size) { return std::clamp(v * size - 0.5, 0.0, size - 1.0); }
+
+    double at(int eta, int alpha, int mu) const { return values[(eta * alpha_size + alpha) * mu_size + mu]; }
+    double lookup(double mu, double alpha, double eta) const
+    {
+        double m = value_to_grid(std::abs(mu), mu_size);
+        double a = value_to_grid(alpha, alpha_size);
+        double e = std::clamp(eta, 0.0, num_eta - 1.0);
+        int m0 = std::min(int(m), mu_size - 2), a0 = std::min(int(a), alpha_size - 2);
+        int e0 = std::min(int(e), std::max(0, num_eta - 2));
+        double fm = m - m0, fa = a - a0, fe = e - e0;
+        int e1 = std::min(e0 + 1, num_eta - 1);
+
+        auto bilinear = [&](int ei)
+        {
+            double low = at(ei, a0, m0) * (1 - fm) + at(ei, a0, m0 + 1) * fm;
+            double high = at(ei, a0 + 1, m0) * (1 - fm) + at(ei, a0 + 1, m0 + 1) * fm;
+            return low * (1 - fa) + high * fa;
+        };
+        return bilinear(e0) * (1 - fe) + bilinear(e1) * fe;
+    }
+
+    //wo at angle acos(mu) in the xz plane
+    static vec3 view_direction(double mu)
+    {
+        return vec3(std::sqrt(std::max(0.0, 1 - mu * mu)), 0, mu);
+    }
+
+    static microfacet_albedo build_conductor()
+    {
+        microfacet_albedo table;
+        table.values.resize(alpha_size * mu_size);
+        for (int a = 0; a < alpha_size; a++)
+        {
+            double alpha = grid_to_value(a, alpha_size);
+            trowbridge_reitz distrib(alpha, alpha);
+            for (int m = 0; m < mu_size; m++)
+            {
+                vec3 wo = view_direction(grid_to_value(m, mu_size));
+                //sampling the visible normals, f * cos / pdf is G(wo, wi) / G1(wo)
+                double sum = 0;
+                for (int i = 0; i < conductor_strata; i++)
+                {
+                    for (int j = 0; j < conductor_strata; j++)
+                    {
+                        vec3 wm = distrib.sample_wm(wo, grid_to_value(i, conductor_strata), grid_to_value(j, conductor_strata));
+                        vec3 wi = reflect(-wo, wm);
+                        if (wi.z() > 0) sum += distrib.G(wo, wi) / distrib.G1(wo);
+                    }
+                }
+                table.values[a * mu_size + m] = float(sum / (conductor_strata * conductor_strata));
+            }
+        }
+        return table;
+    }
+
+    static microfacet_albedo build_dielectric()
+    {
+        microfacet_albedo table;
+        table.num_eta = eta_size;
+        table.values.resize(eta_size * alpha_size * mu_size);
+        for (int e = 0; e < eta_size; e++)
+        {
+            double eta = std::pow(max_eta, 2.0 * e / (eta_size - 1) - 1);
+            for (int a = 0; a < alpha_size; a++)
+            {
+                double alpha = grid_to_value(a, alpha_size);
+                trowbridge_reitz distrib(alpha, alpha);
+                for (int m = 0; m < mu_size; m++)
+                {
+                    vec3 wo = view_direction(grid_to_value(m, mu_size));
+                    //both the reflected and the refracted direction of every sampled facet, weighted by fresnel
+                    double sum = 0;
+                    for (int i = 0; i < dielectric_strata; i++)
+                    {
+                        for (int j = 0; j < dielectric_strata; j++)
+                        {
+                            vec3 wm = distrib.sample_wm(wo, grid_to_value(i, dielectric_strata), grid_to_value(j, dielectric_strata));
+                            double cos_o = dot(wo, wm);
+                            double reflectance = fresnel_dielectric::reflectance(cos_o, 1, eta);
+                            vec3 wr = reflect(-wo, wm);
+                            if (wr.z() > 0) sum += reflectance * distrib.G(wo, wr) / distrib.G1(wo);
+                            if (reflectance < 1)
+                            {
+                                vec3 wt = refract(-wo, wm, 1 / eta);
+                                if (wt.z() < 0) sum += (1 - reflectance) * distrib.G(wo, wt) / distrib.G1(wo);
+                            }
+                        }
+                    }
+                    table.values[(e * alpha_size + a) * mu_size + m] = float(sum / (dielectric_strata * dielectric_strata));
+                }
+            }
+        }
+        return table;
+    }
+};
+
+#endif //MICROFACET_H
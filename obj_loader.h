@@ -4,13 +4,25 @@
 
 #ifndef OBJ_LOADER_H
 #define OBJ_LOADER_H
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <condition_variable>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
-#include <fstream>
-#include <filesystem>
+#include <mutex>
+#include <numeric>
+#include <optional>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
 #include <utility>
+#include "mapped_file.h"
+#include "mesh_file.h"
 #include "triangle_mesh.h"
-#include "material.h"
-#include "triangle.h"
+#include "material_registry.h"
 
 #include "filesystem.hpp"
 namespace fs = ghc::filesystem;
@@ -19,6 +31,9 @@ class obj_loader
 {
 public:
     std::vector<std::string> obj_filepaths;
+    //keep a binary copy of each loaded mesh (with its bvh) next to its obj, and map that instead of parsing next time
+    bool use_cache = true;
+    obj_loader() = default;
     obj_loader(const std::string& obj_folder_path)
     {
         //detect every .obj in the folder, store their (valid) paths in an array
@@ -33,120 +48,691 @@ public:
 
     /**
      * @param obj_name
-     * @param mat the material to make this mesh
+     * @param mat the material to make this mesh, usemtl groups are ignored
+     * @param quantize store the mesh's vertices in the compact quantized format
+     * @param num_threads how many threads parse the file, 0 to use every core
      * @return a shared_ptr to the triangle_mesh in the .obj file with name obj_name,
      * and nullptr if no .obj file found of that name
      */
-    shared_ptr<triangle_mesh> load(const std::string& obj_name, const shared_ptr<material>& mat)
+    shared_ptr<triangle_mesh> load(const std::string& obj_name, material_id mat, bool quantize = false,
+                                   unsigned num_threads = 0)
+    {
+        mesh_file::slot_names names;
+        shared_ptr<triangle_mesh> mesh = load_file(find_path(obj_name), quantize, num_threads, names);
+        if (!mesh) return nullptr;
+        for (std::uint32_t slot = 0; slot < mesh->num_material_slots(); slot++) mesh->set_slot_material(slot, mat);
+        return mesh;
+    }
+
+    /**
+     * Loads the obj with the materials from its mtllib files. each usemtl group gets its material from the mtl,
+     * added to materials (identical definitions, even from different files, end up as one material)
+     * @param obj_name
+     * @param materials the scene's registry
+     * @param fallback material for faces before any usemtl, or whose material isn't in any mtl
+     * @param quantize store the mesh's vertices in the compact quantized format
+     * @param num_threads how many threads parse the file, 0 to use every core
+     * @return a shared_ptr to the triangle_mesh in the .obj file with name obj_name,
+     * and nullptr if no .obj file found of that name
+     */
+    shared_ptr<triangle_mesh> load(const std::string& obj_name, material_registry& materials, material_id fallback,
+                                   bool quantize = false, unsigned num_threads = 0)
+    {
+        std::string path = find_path(obj_name);
+        mesh_file::slot_names names;
+        shared_ptr<triangle_mesh> mesh = load_file(path, quantize, num_threads, names);
+        if (!mesh) return nullptr;
+        //mtllib paths are relative to the obj
+        assign_materials(*mesh, names, fs::path(path).parent_path().string(), materials, fallback);
+        return mesh;
+    }
+
+    /**
+     * The mesh in the obj at path, from the cache if it's fresh. its material slots are all left at material 0
+     * @param path
+     * @param quantize store the mesh's vertices in the compact quantized format
+     * @param num_threads how many threads parse the file, 0 to use every core
+     * @param names gets the mtllib files and the usemtl name of each slot
+     * @return the mesh, or nullptr if the file can't be read
+     */
+    shared_ptr<triangle_mesh> load_file(const std::string& path, bool quantize, unsigned num_threads,
+                                        mesh_file::slot_names& names) const
+    {
+        if (path.empty())
+        {
+            std::clog << "Could not find OBJ of that name, returning nullptr" << std::endl;
+            return nullptr;
+        }
+
+        //the file is parsed in place, straight out of the mapping
+        mapped_file file(path);
+        if (!file.is_open()) return nullptr;
+        auto source = std::span<const std::byte>(file.data(), file.size());
+
+        std::string cache_path = path + ".rtmesh";
+        mesh_file::source_key key;
+        key.settings = cache_settings(quantize);
+        key.size = file.size();
+        key.modified = static_cast<std::int64_t>(fs::last_write_time(path).time_since_epoch().count());
+        if (use_cache)
+        {
+            //same size and timestamp is trusted as is, otherwise the contents decide (ex: the file was touched or checked out again)
+            auto cached = mesh_file::read_key(cache_path);
+            if (cached && cached->settings == key.settings && cached->size == key.size)
+            {
+                key.hash = cached->modified == key.modified ? cached->hash : mesh_file::hash_bytes(source);
+                if (key.hash == cached->hash)
+                {
+                    if (auto mesh = mesh_file::load(cache_path, 0, &names))
+                    {
+                        std::clog << "mapped cached mesh: " << cache_path << std::endl;
+                        return mesh;
+                    }
+                }
+            }
+        }
+
+        std::clog << "reading: " << path << std::endl;
+        if (num_threads == 0) num_threads = std::max(1u, std::thread::hardware_concurrency());
+        obj_data data;
+        parse_and_build(std::string_view(reinterpret_cast<const char*>(file.data()), file.size()), num_threads, quantize, data);
+        shared_ptr<triangle_mesh> mesh = build_mesh(data);
+        names.libraries = data.libraries;
+        names.slots = data.slot_names;
+
+        if (use_cache)
+        {
+            key.hash = mesh_file::hash_bytes(source);
+            mesh_file::write(*mesh, cache_path, key, names);
+        }
+        return mesh;
+    }
+
+    /**
+     * Gives each of the mesh's material slots its material from the mtl files, see load()
+     * @param mesh
+     * @param names what load_file() gave back for the mesh
+     * @param folder where the obj is, the mtl paths are relative to it
+     * @param materials the scene's registry
+     * @param fallback
+     */
+    static void assign_materials(triangle_mesh& mesh, const mesh_file::slot_names& names, const std::string& folder,
+                                 material_registry& materials, material_id fallback)
+    {
+        std::unordered_map<std::string, mtl_material> library;
+        for (const std::string& lib : names.libraries) parse_mtl((fs::path(folder) / lib).string(), library);
+
+        for (std::uint32_t slot = 0; slot < mesh.num_material_slots(); slot++)
+        {
+            const std::string& name = slot < names.slots.size() ? names.slots[slot] : std::string();
+            auto it = library.find(name);
+            if (it == library.end())
+            {
+                if (!name.empty()) std::clog << "No material named " << name << " in the mtl files, using the fallback" << std::endl;
+                mesh.set_slot_material(slot, fallback);
+            }
+            else mesh.set_slot_material(slot, it->second.add_to(materials));
+        }
+    }
+private:
+    //the parts of an mtl material this renderer can use
+    struct mtl_material
+    {
+        color kd = color(0.8, 0.8, 0.8); //diffuse
+        color ks = color(0, 0, 0); //specular
+        color ke = color(0, 0, 0); //emission
+        double ns = 0; //specular exponent
+        double ni = 1.5; //ior
+        double d = 1; //opacity
+        int illum = 2;
+
+        material_id add_to(material_registry& materials) const
+        {
+            if (ke.length_squared() > 0) return materials.add<diffuse_light>(ke, kd);
+            //illum 4, 6, 7 and 9 are the glass/refraction models
+            if (d < 1 || illum == 4 || illum == 6 || illum == 7 || illum == 9) return materials.add<dielectric>(ni > 1 ? ni : 1.5);
+            if (illum == 3 || illum == 5)
+            {
+                //blinn-phong exponent to a roughness, sqrt(2 / (ns + 2)) (walter et al. 2007)
+                return materials.add<metal>(ks, std::sqrt(2 / (ns + 2)));
+            }
+            return materials.add<lambertian>(kd);
+        }
+    };
+
+    //adds every newmtl in the file to library, a name that's already there keeps its first definition
+    static void parse_mtl(const std::string& path, std::unordered_map<std::string, mtl_material>& library)
+    {
+        mapped_file file(path);
+        if (!file.is_open()) return;
+        const char* p = reinterpret_cast<const char*>(file.data());
+        const char* end = p + file.size();
+
+        mtl_material scratch; //statements before the first newmtl go nowhere
+        mtl_material* current = &scratch;
+        while (p < end)
+        {
+            skip_spaces(p, end);
+            const char* keyword = p;
+            while (p < end && !is_space(*p) && *p != '\n') p++;
+            std::string_view k(keyword, p - keyword);
+
+            if (k == "newmtl")
+            {
+                auto [it, added] = library.try_emplace(std::string(rest_of_line(p, end)));
+                current = added ? &it->second : &scratch;
+            }
+            else if (k == "Kd") parse_reals(p, end, current->kd, 3);
+            else if (k == "Ks") parse_reals(p, end, current->ks, 3);
+            else if (k == "Ke") parse_reals(p, end, current->ke, 3);
+            else if (k == "Ns") parse_scalar(p, end, current->ns);
+            else if (k == "Ni") parse_scalar(p, end, current->ni);
+            else if (k == "d") parse_scalar(p, end, current->d);
+            else if (k == "Tr")
+            {
+                //transparency, the opposite of d
+                double tr = 0;
+                if (parse_scalar(p, end, tr)) current->d = 1 - tr;
+            }
+            else if (k == "illum")
+            {
+                skip_spaces(p, end);
+                parse_number(p, end, current->illum);
+            }
+            skip_line(p, end);
+        }
+    }
+
+    static bool parse_scalar(const char*& p, const char* end, double& value)
+    {
+        skip_spaces(p, end);
+        return parse_number(p, end, value);
+    }
+
+    std::string find_path(const std::string& obj_name) const
     {
         //find the obj with this name in our array
         std::string path;
         for (const std::string& s : obj_filepaths)
         {
-            if (s.compare(s.length() - obj_name.length(), obj_name.length(), obj_name) == 0)
+            if (s.ends_with(obj_name))
             {
                 path = s;
             }
         }
-        if (path.empty())
+        return path;
+    }
+
+    //one bit per load option that changes the built mesh, so a cache built with other options isn't used.
+    //things fixed in code (ex: the bvh leaf size) need a mesh_file::version bump instead
+    static std::uint64_t cache_settings(bool quantize)
+    {
+        return quantize ? 1 : 0;
+    }
+
+    //smaller files aren't worth splitting, thread startup would cost more than it saves
+    static constexpr size_t min_chunk_bytes = size_t(1) << 20;
+
+    //everything parsed out of an obj, before v/vt/vn combinations are turned into mesh vertices
+    struct obj_data
+    {
+        std::vector<point3> v;
+        std::vector<point3> vt;
+        std::vector<vec3> vn;
+        std::vector<std::array<int, 3>> corners; //(v, vt, vn) per triangle corner, 0-based, -1 if missing
+        std::vector<std::uint32_t> triangle_slots; //material slot per triangle, empty if the obj never uses usemtl
+        std::vector<std::string> slot_names; //usemtl name per slot, "" for faces before the first usemtl
+        std::vector<std::string> libraries; //mtllib files
+        flat_bvh bvh; //over the triangles in corners order
+        std::optional<position_quantizer> codec; //set if the mesh is quantized, the bvh's bounds hold its decoded positions
+    };
+
+    //what one chunk's parse produces besides its vertices, which go straight into obj_data
+    struct chunk_output
+    {
+        std::vector<std::array<int, 3>> corners;
+        std::vector<std::pair<std::uint32_t, std::string_view>> material_switches; //(first triangle in the chunk, usemtl name)
+        std::vector<std::string_view> libraries;
+
+        //filled in after the parse: the chunk's triangles grouped by material, and the bvh over them
+        std::vector<std::pair<std::uint32_t, std::uint32_t>> runs; //(first triangle, key), key 0 carries on the previous chunk's material
+        std::vector<std::string_view> key_names; //usemtl name of each key but 0
+        flat_bvh::part bvh;
+    };
+
+    /*
+     * the file is split at line boundaries into one chunk per thread. a first pass counts each chunk's v/vt/vn lines,
+     * which gives every chunk the global index its vertices start at. then the chunks are parsed at the same time,
+     * writing vertices straight into their final slots and fixing up relative (negative) indices as they go.
+     * the bvh build is pipelined with the parse: as soon as a chunk is parsed and the chunks holding the vertices
+     * its faces use are too, its thread builds a bvh part over the chunk's triangles while other chunks may still be
+     * parsing. the parts are joined at the end and the per chunk triangle lists are joined in order.
+     * when quantizing, the codec depends on every position, so the parts are built over full precision positions
+     * and the joined tree is refit to the decoded ones once all chunks are in
+     */
+    static void parse_and_build(std::string_view text, unsigned num_threads, bool quantize, obj_data& data)
+    {
+        size_t num_chunks = std::clamp<size_t>(text.size() / min_chunk_bytes, 1, num_threads);
+        std::vector<std::string_view> chunks;
+        size_t start = 0;
+        for (size_t i = 1; i <= num_chunks && start < text.size(); i++)
         {
-            std::clog << "Could not find OBJ of that name, returning nullptr" << std::endl;
-            return nullptr;
+            size_t end = i == num_chunks ? text.size() : text.find('\n', std::max(start, text.size() * i / num_chunks));
+            end = end == std::string_view::npos ? text.size() : end + 1;
+            chunks.push_back(text.substr(start, end - start));
+            start = end;
+        }
+
+        std::vector<std::array<size_t, 3>> bases(chunks.size());
+        for_each_chunk(chunks.size(), [&](size_t i){ bases[i] = count_elements(chunks[i]); });
+        //counts to exclusive prefix sums
+        std::array<size_t, 3> totals = {0, 0, 0};
+        for (auto& base : bases)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                size_t count = base[k];
+                base[k] = totals[k];
+                totals[k] += count;
+            }
+        }
+        data.v.resize(totals[0]);
+        data.vt.resize(totals[1]);
+        data.vn.resize(totals[2]);
+        //chunk i's v lines fill [vertex_starts[i], vertex_starts[i + 1])
+        std::vector<size_t> vertex_starts(chunks.size() + 1, totals[0]);
+        for (size_t i = 0; i < chunks.size(); i++) vertex_starts[i] = bases[i][0];
+
+        std::vector<chunk_output> outputs(chunks.size());
+        std::vector<aabb> vertex_bounds(chunks.size(), aabb::empty);
+        std::vector<char> parsed(chunks.size(), 0);
+        std::mutex mutex;
+        std::condition_variable parsed_changed;
+        for_each_chunk(chunks.size(), [&](size_t i)
+        {
+            parse(chunks[i], bases[i], data, outputs[i]);
+            if (quantize)
+            {
+                for (size_t v = vertex_starts[i]; v < vertex_starts[i + 1]; v++) vertex_bounds[i] = aabb(vertex_bounds[i], aabb(data.v[v], data.v[v]));
+            }
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                parsed[i] = 1;
+            }
+            parsed_changed.notify_all();
+
+            //wait for the chunks holding the vertices this one's faces use, the usual obj has them all in the first chunks
+            size_t lowest = data.v.size(), highest = 0;
+            for (const auto& corner : outputs[i].corners)
+            {
+                lowest = std::min(lowest, static_cast<size_t>(corner[0]));
+                highest = std::max(highest, static_cast<size_t>(corner[0]) + 1);
+            }
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                parsed_changed.wait(lock, [&]
+                {
+                    for (size_t j = 0; j < chunks.size(); j++)
+                    {
+                        if (!parsed[j] && vertex_starts[j] < highest && vertex_starts[j + 1] > lowest) return false;
+                    }
+                    return true;
+                });
+            }
+            build_chunk_bvh(data, outputs[i]);
+        });
+
+        size_t num_corners = 0;
+        bool any_usemtl = false;
+        std::vector<flat_bvh::part> parts;
+        for (chunk_output& out : outputs)
+        {
+            num_corners += out.corners.size();
+            any_usemtl = any_usemtl || !out.material_switches.empty();
+            parts.push_back(std::move(out.bvh));
+        }
+        data.bvh.join(std::move(parts));
+        data.corners.reserve(num_corners);
+        for (const chunk_output& out : outputs)
+        {
+            data.corners.insert(data.corners.end(), out.corners.begin(), out.corners.end());
+            for (std::string_view lib : out.libraries) data.libraries.emplace_back(lib);
+        }
+        if (quantize)
+        {
+            aabb bounds = aabb::empty;
+            for (const aabb& b : vertex_bounds) bounds = aabb(bounds, b);
+            const position_quantizer& codec = data.codec.emplace(bounds);
+            //bounds over the positions the mesh will actually have
+            auto position = [&](int v){ return codec.decode(codec.encode(data.v[v])); };
+            data.bvh.refit([&](std::uint32_t tri)
+            {
+                point3 p0 = position(data.corners[3*tri][0]);
+                point3 p1 = position(data.corners[3*tri + 1][0]);
+                point3 p2 = position(data.corners[3*tri + 2][0]);
+                return aabb(aabb(p0, p1), aabb(p2, p2));
+            });
         }
+        if (!any_usemtl) return;
 
-        std::string line;
+        //a chunk's faces before its first usemtl carry on with the material the previous chunk ended with
+        data.triangle_slots.reserve(num_corners / 3);
+        std::unordered_map<std::string_view, std::uint32_t> slots;
+        auto slot_for = [&](std::string_view name)
+        {
+            auto [it, added] = slots.emplace(name, static_cast<std::uint32_t>(data.slot_names.size()));
+            if (added) data.slot_names.emplace_back(name);
+            return it->second;
+        };
+        std::uint32_t current = slot_for("");
+        for (const chunk_output& out : outputs)
+        {
+            auto num_triangles = static_cast<std::uint32_t>(out.corners.size() / 3);
+            for (size_t r = 0; r < out.runs.size(); r++)
+            {
+                auto [first, key] = out.runs[r];
+                std::uint32_t last = r + 1 < out.runs.size() ? out.runs[r + 1].first : num_triangles;
+                std::uint32_t slot = key == 0 ? current : slot_for(out.key_names[key - 1]);
+                data.triangle_slots.insert(data.triangle_slots.end(), last - first, slot);
+            }
+            //switches after the chunk's last face still count for the next chunk
+            if (!out.material_switches.empty()) current = slot_for(out.material_switches.back().second);
+        }
+    }
 
-        hittable_list mesh_faces;
-        std::vector<point3> global_v;
-        std::vector<point3> global_vt;
-        std::vector<point3> global_vn;
+    //groups the chunk's triangles by material (keeping their order otherwise) and builds its bvh part
+    static void build_chunk_bvh(const obj_data& data, chunk_output& out)
+    {
+        auto num_triangles = static_cast<std::uint32_t>(out.corners.size() / 3);
+        std::vector<std::uint32_t> keys(num_triangles, 0);
+        std::unordered_map<std::string_view, std::uint32_t> key_of;
+        for (size_t s = 0; s < out.material_switches.size(); s++)
+        {
+            auto [first, name] = out.material_switches[s];
+            auto [it, added] = key_of.emplace(name, static_cast<std::uint32_t>(out.key_names.size() + 1));
+            if (added) out.key_names.push_back(name);
+            std::uint32_t last = s + 1 < out.material_switches.size() ? out.material_switches[s + 1].first : num_triangles;
+            std::fill(keys.begin() + first, keys.begin() + last, it->second);
+        }
 
-        std::ifstream read_obj(path);
-        std::clog << "reading: " << path << std::endl;
-        while (getline(read_obj, line))
+        std::vector<std::uint32_t> group_starts;
+        if (!out.key_names.empty())
         {
-            auto tokens = tokenize(line, " ");
-            const std::string& first_token = tokens[0];
-            if (first_token == "v")
+            std::vector<std::uint32_t> order(num_triangles);
+            std::iota(order.begin(), order.end(), 0);
+            std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b){ return keys[a] < keys[b]; });
+            std::vector<std::array<int, 3>> sorted(out.corners.size());
+            for (std::uint32_t t = 0; t < num_triangles; t++)
             {
-                //read to global_v
-                double x = std::stod(tokens[1]);
-                double y = std::stod(tokens[2]);
-                double z = std::stod(tokens[3]);
-                global_v.emplace_back(x, y, z);
+                std::uint32_t tri = order[t];
+                for (int k = 0; k < 3; k++) sorted[3*t + k] = out.corners[3*tri + k];
+                if (out.runs.empty() || out.runs.back().second != keys[tri])
+                {
+                    if (t > 0) group_starts.push_back(t);
+                    out.runs.emplace_back(t, keys[tri]);
+                }
             }
-            else if (first_token == "vt")
+            out.corners = std::move(sorted);
+        }
+        else out.runs.emplace_back(0, 0);
+
+        std::vector<aabb> bounds;
+        bounds.reserve(num_triangles);
+        for (std::uint32_t t = 0; t < num_triangles; t++)
+        {
+            const point3& p0 = data.v[out.corners[3*t][0]];
+            const point3& p1 = data.v[out.corners[3*t + 1][0]];
+            const point3& p2 = data.v[out.corners[3*t + 2][0]];
+            bounds.emplace_back(aabb(p0, p1), aabb(p2, p2));
+        }
+        out.bvh = flat_bvh::build_part(bounds, triangle_mesh::max_leaf_size, std::move(group_starts));
+    }
+
+    //runs fn(i) for every chunk i, each on its own thread (the first on this one)
+    template <typename Fn>
+    static void for_each_chunk(size_t num_chunks, Fn&& fn)
+    {
+        std::vector<std::thread> workers;
+        for (size_t i = 1; i < num_chunks; i++) workers.emplace_back([&fn, i]{ fn(i); });
+        if (num_chunks > 0) fn(0);
+        for (std::thread& w : workers) w.join();
+    }
+
+    //number of v, vt and vn lines
+    static std::array<size_t, 3> count_elements(std::string_view text)
+    {
+        std::array<size_t, 3> counts = {0, 0, 0};
+        const char* p = text.data();
+        const char* end = p + text.size();
+        while (p < end)
+        {
+            skip_spaces(p, end);
+            const char* keyword = p;
+            while (p < end && !is_space(*p) && *p != '\n') p++;
+            int k = element_kind(keyword, p - keyword);
+            if (k >= 0) counts[k]++;
+            skip_line(p, end);
+        }
+        return counts;
+    }
+
+    //0 for v, 1 for vt, 2 for vn, -1 for anything else
+    static int element_kind(const char* keyword, std::ptrdiff_t len)
+    {
+        if (keyword[0] != 'v' || len > 2) return -1;
+        if (len == 1) return 0;
+        if (keyword[1] == 't') return 1;
+        if (keyword[1] == 'n') return 2;
+        return -1;
+    }
+
+    /*
+     * the parser walks the text with a cursor and never copies it: no getline, no per line or per token strings.
+     * numbers go through std::from_chars, which doesn't allocate or look at the locale
+     * @param base global index of the chunk's first v, vt and vn
+     */
+    static void parse(std::string_view text, std::array<size_t, 3> base, obj_data& data,
+                      chunk_output& out)
+    {
+        std::vector<std::array<int, 3>>& corners = out.corners;
+        const char* p = text.data();
+        const char* end = p + text.size();
+        std::array<size_t, 3> next = base; //index the next v/vt/vn line goes to, the same count count_elements saw
+        const std::array<size_t, 3> totals = {data.v.size(), data.vt.size(), data.vn.size()};
+        std::vector<std::array<int, 3>> face; //reused by every face line
+        while (p < end)
+        {
+            skip_spaces(p, end);
+            const char* keyword = p;
+            while (p < end && !is_space(*p) && *p != '\n') p++;
+            auto len = p - keyword;
+
+            int kind = element_kind(keyword, len);
+            if (kind == 0)
+            {
+                //a line that doesn't parse still takes its slot, so later indices stay right
+                parse_reals(p, end, data.v[next[0]++], 3);
+            }
+            else if (kind == 1)
             {
-                //read to global_vt
-                double x = std::stod(tokens[1]);
-                double y = std::stod(tokens[2]);
-                double z = 0;
-                global_vt.emplace_back(x, y, z);
+                //only u and v are used, a w coordinate is ignored
+                parse_reals(p, end, data.vt[next[1]++], 2);
             }
-            else if (first_token == "vn")
+            else if (kind == 2)
             {
-                //read to global_vn
-                double x = std::stod(tokens[1]);
-                double y = std::stod(tokens[2]);
-                double z = std::stod(tokens[3]);
-                global_vn.emplace_back(x, y, z);
+                parse_reals(p, end, data.vn[next[2]++], 3);
             }
-            else if (first_token == "f")
+            else if (len == 1 && keyword[0] == 'f')
             {
-                std::vector<int> vertex_indices;
-                for (int j = 1; j <= 3; j++)
+                face.clear();
+                std::array<int, 3> corner;
+                while (parse_corner(p, end, next, totals, corner)) face.push_back(corner);
+                //triangulate as a fan around the first corner, fine for the convex faces modelers write
+                for (size_t i = 2; i < face.size(); i++)
                 {
-                    std::vector<std::string> indices = tokenize(tokens[j], "/");
-                    //TODO we currently don't care abt texture coords or vertex normals
-                    vertex_indices.push_back(std::stoi(indices[0]));
+                    corners.push_back(face[0]);
+                    corners.push_back(face[i - 1]);
+                    corners.push_back(face[i]);
                 }
-                size_t v0 = vertex_indices[0]-1;
-                size_t v1 = vertex_indices[1]-1;
-                size_t v2 = vertex_indices[2]-1;
-                auto tri = make_shared<triangle>(global_v[v0], global_v[v1],
-                                                 global_v[v2], mat);
-                //std::clog << "tri: " << vertex_indices[0] << ", " << vertex_indices[1] << ", " << vertex_indices[2] << std::endl;
-                //std::clog << tri->to_string() << std::endl;
-                mesh_faces.add(tri);
-
-                if (tokens.size() == 5) //we have a quad face to triangulate
+            }
+            else if (std::string_view(keyword, len) == "usemtl")
+            {
+                out.material_switches.emplace_back(static_cast<std::uint32_t>(corners.size() / 3), rest_of_line(p, end));
+            }
+            else if (std::string_view(keyword, len) == "mtllib")
+            {
+                //one or more file names
+                while (true)
                 {
-                    std::vector<std::string> indices = tokenize(tokens[4], "/");
-                    vertex_indices.push_back(std::stoi(indices[0]));
-                    size_t v3 = vertex_indices[3]-1;
-                    auto tri1 = make_shared<triangle>(global_v[v0], global_v[v2],
-                                                      global_v[v3], mat);
-                    mesh_faces.add(tri1);
-                    //std::clog << "tri1: " << vertex_indices[0] << ", " << vertex_indices[2] << ", " << vertex_indices[3] << std::endl;
-                    //std::clog << tri1->to_string() << std::endl;
+                    skip_spaces(p, end);
+                    const char* name = p;
+                    while (p < end && !is_space(*p) && *p != '\n') p++;
+                    if (p == name) break;
+                    out.libraries.emplace_back(name, p - name);
                 }
             }
+            //anything else (comments, g, s...) is skipped
+            skip_line(p, end);
         }
-        shared_ptr<triangle_mesh> mesh = make_shared<triangle_mesh>(mesh_faces, global_v, global_vn, global_vt,
-                                                                    mat);
-        return mesh;
     }
-private:
+
+    //the rest of the line without surrounding spaces, material names can have spaces in them
+    static std::string_view rest_of_line(const char*& p, const char* end)
+    {
+        skip_spaces(p, end);
+        const char* start = p;
+        while (p < end && *p != '\n') p++;
+        const char* stop = p;
+        while (stop > start && is_space(stop[-1])) stop--;
+        return std::string_view(start, stop - start);
+    }
+
+    static bool is_space(char c) { return c == ' ' || c == '\t' || c == '\r'; }
+    static void skip_spaces(const char*& p, const char* end)
+    {
+        while (p < end && is_space(*p)) p++;
+    }
+    static void skip_line(const char*& p, const char* end)
+    {
+        while (p < end && *p != '\n') p++;
+        if (p < end) p++;
+    }
+
+    template <typename T>
+    static bool parse_number(const char*& p, const char* end, T& value)
+    {
+        if (p < end && *p == '+') p++; //from_chars doesn't take a leading +
+#if defined(__cpp_lib_to_chars)
+        auto [next, ec] = std::from_chars(p, end, value);
+        if (ec != std::errc()) return false;
+        p = next;
+        return true;
+#else
+        if constexpr (std::is_integral_v<T>)
+        {
+            auto [next, ec] = std::from_chars(p, end, value);
+            if (ec != std::errc()) return false;
+            p = next;
+            return true;
+        }
+        else
+        {
+            //no floating point from_chars in this standard library, strtod needs a terminated copy
+            char buf[64];
+            size_t n = 0;
+            while (p + n < end && n < sizeof(buf) - 1 && !is_space(p[n]) && p[n] != '\n') n++;
+            std::memcpy(buf, p, n);
+            buf[n] = 0;
+            char* stop;
+            value = static_cast<T>(std::strtod(buf, &stop));
+            if (stop == buf) return false;
+            p += stop - buf;
+            return true;
+        }
+#endif
+    }
+
+    static bool parse_reals(const char*& p, const char* end, vec3& out, int count)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            skip_spaces(p, end);
+            if (!parse_number(p, end, out[i])) return false;
+        }
+        return true;
+    }
+
     /**
-     *
-     * @param line the string to parse
-     * @return array of tokens (strings)
+     * Reads one v, v/vt, v//vn or v/vt/vn group of a face line
+     * @return false at the end of the line or on something that isn't a corner
      */
-    static std::vector<std::string> tokenize(std::string& line, const std::string& delim)
+    static bool parse_corner(const char*& p, const char* end, const std::array<size_t, 3>& current,
+                             const std::array<size_t, 3>& totals, std::array<int, 3>& corner)
     {
-        //input code modified from stack overflow: https://stackoverflow.com/questions/14265581/parse-split-a-string-in-c-using-string-delimiter-standard-c
+        skip_spaces(p, end);
+        int raw[3] = {0, 0, 0};
+        if (!parse_number(p, end, raw[0])) return false;
+        for (int k = 1; k < 3 && p < end && *p == '/'; k++)
+        {
+            p++;
+            if (p < end && *p != '/') parse_number(p, end, raw[k]);
+        }
 
-        std::vector<std::string> result;
-        size_t pos = line.find(delim);
-        do
+        //1 based, and negative indices count back from the latest element read so far
+        for (int k = 0; k < 3; k++)
         {
-            result.push_back(line.substr(0, pos));
-            line.erase(0, pos + delim.length());
-            pos = line.find(delim);
-        }while (pos != std::string::npos);
-        if (!line.empty()) result.push_back(line);
+            long long i = raw[k] > 0 ? raw[k] - 1 : raw[k] < 0 ? static_cast<long long>(current[k]) + raw[k] : -1;
+            corner[k] = i >= 0 && i < static_cast<long long>(totals[k]) ? static_cast<int>(i) : -1;
+        }
+        return corner[0] >= 0;
+    }
+
+    static shared_ptr<triangle_mesh> build_mesh(obj_data& data)
+    {
+        //obj indexes v, vt and vn separately but the mesh has one index per vertex,
+        //so every distinct v/vt/vn combination used by a face becomes one mesh vertex.
+        //combinations are found through the position they use, almost always there's only one per position
+        constexpr std::uint32_t none = ~std::uint32_t(0);
+        std::vector<std::uint32_t> first_with_v(data.v.size(), none);
+        std::vector<std::uint32_t> next_with_same_v;
+        std::vector<std::array<int, 3>> vertex_refs;
+        std::vector<std::uint32_t> indices;
+        indices.reserve(data.corners.size());
+        bool all_vt = true;
+        bool all_vn = true;
 
-        return result;
+        for (const auto& corner : data.corners)
+        {
+            std::uint32_t id = first_with_v[corner[0]];
+            while (id != none && vertex_refs[id] != corner) id = next_with_same_v[id];
+            if (id == none)
+            {
+                id = static_cast<std::uint32_t>(vertex_refs.size());
+                vertex_refs.push_back(corner);
+                next_with_same_v.push_back(first_with_v[corner[0]]);
+                first_with_v[corner[0]] = id;
+                all_vt = all_vt && corner[1] >= 0;
+                all_vn = all_vn && corner[2] >= 0;
+            }
+            indices.push_back(id);
+        }
+
+        std::vector<point3> positions;
+        std::vector<vec3> normals;
+        std::vector<point3> uvs;
+        positions.reserve(vertex_refs.size());
+        if (all_vt) uvs.reserve(vertex_refs.size());
+        if (all_vn) normals.reserve(vertex_refs.size());
+        for (const auto& ref : vertex_refs)
+        {
+            positions.push_back(data.v[ref[0]]);
+            if (all_vt) uvs.push_back(data.vt[ref[1]]);
+            if (all_vn) normals.push_back(data.vn[ref[2]]);
+        }
+        //the loader assigns the slots their materials
+        std::vector<material_id> slot_materials(std::max<size_t>(data.slot_names.size(), 1), 0);
+        return make_shared<triangle_mesh>(std::move(positions), std::move(normals), std::move(uvs), std::move(indices),
+                                          data.triangle_slots, std::move(slot_materials), std::move(data.bvh), data.codec);
     }
 };
 
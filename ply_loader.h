@@ -0,0 +1,465 @@
+//
+// Created by Faye Yu on 1/16/26.
+//
+
+#ifndef PLY_LOADER_H
+#define PLY_LOADER_H
+
+#include <algorithm>
+#include <bit>
+#include <charconv>
+#include <cstring>
+#include <iostream>
+#include <string_view>
+#include "mapped_file.h"
+#include "triangle_mesh.h"
+
+#include "filesystem.hpp"
+namespace fs = ghc::filesystem;
+
+class ply_loader
+{
+/*
+ * loads binary PLY files (what scanners and most mesh tools write) straight into triangle_mesh's buffers.
+ * the header says how every element is laid out, so the body is read in place out of the mapping:
+ * vertices go directly into the position/normal/uv arrays and faces into the index array,
+ * with no text in between and nothing allocated per face. ascii PLY isn't supported, convert those to obj
+ */
+public:
+    std::vector<std::string> ply_filepaths;
+    ply_loader() = default;
+    ply_loader(const std::string& ply_folder_path)
+    {
+        for (auto const& entry : fs::directory_iterator(ply_folder_path))
+        {
+            if (entry.is_regular_file() && entry.path().extension().string() == ".ply")
+            {
+                ply_filepaths.push_back(entry.path().string());
+            }
+        }
+    }
+
+    /**
+     * @param ply_name
+     * @param mat the material to make this mesh
+     * @param quantize store the mesh's vertices in the compact quantized format
+     * @return a shared_ptr to the triangle_mesh in the .ply file with name ply_name,
+     * and nullptr if there's no .ply of that name or it can't be read
+     */
+    shared_ptr<triangle_mesh> load(const std::string& ply_name, material_id mat, bool quantize = false) const
+    {
+        std::string path;
+        for (const std::string& s : ply_filepaths)
+        {
+            if (s.ends_with(ply_name)) path = s;
+        }
+        if (path.empty())
+        {
+            std::clog << "Could not find PLY of that name, returning nullptr" << std::endl;
+            return nullptr;
+        }
+        return load_file(path, mat, quantize);
+    }
+
+    /**
+     * @param path
+     * @param mat the material to make this mesh
+     * @param quantize store the mesh's vertices in the compact quantized format
+     * @return the mesh in the .ply file at path, or nullptr if it can't be read
+     */
+    static shared_ptr<triangle_mesh> load_file(const std::string& path, material_id mat, bool quantize = false)
+    {
+        mapped_file file(path);
+        if (!file.is_open()) return nullptr;
+        std::clog << "reading: " << path << std::endl;
+
+        const std::byte* p = file.data();
+        const std::byte* end = p + file.size();
+        std::vector<element> elements;
+        bool swap = false;
+        if (!parse_header(p, end, elements, swap))
+        {
+            std::clog << path << " is not a binary PLY this loader can read, returning nullptr" << std::endl;
+            return nullptr;
+        }
+
+        std::vector<point3> positions;
+        std::vector<vec3> normals;
+        std::vector<point3> uvs;
+        std::vector<std::uint32_t> indices;
+        size_t num_vertices = 0;
+        for (const element& e : elements)
+        {
+            if (e.name == "vertex") num_vertices = e.count;
+        }
+
+        for (const element& e : elements)
+        {
+            bool ok;
+            if (e.name == "vertex") ok = read_vertices(e, p, end, swap, positions, normals, uvs);
+            else if (e.name == "face") ok = read_faces(e, p, end, swap, num_vertices, indices);
+            else ok = skip_element(e, p, end, swap);
+            if (!ok)
+            {
+                std::clog << path << " is truncated or is missing " << e.name << " properties, returning nullptr" << std::endl;
+                return nullptr;
+            }
+        }
+        if (positions.empty() || indices.empty())
+        {
+            std::clog << path << " has no triangles, returning nullptr" << std::endl;
+            return nullptr;
+        }
+        return make_shared<triangle_mesh>(std::move(positions), std::move(normals), std::move(uvs), std::move(indices),
+                                          mat, quantize);
+    }
+private:
+    enum class scalar_type { none, int8, uint8, int16, uint16, int32, uint32, float32, float64 };
+
+    struct property
+    {
+        std::string name;
+        scalar_type type = scalar_type::none;
+        scalar_type count_type = scalar_type::none; //type of the length for a list property, none if it's a scalar
+    };
+
+    struct element
+    {
+        std::string name;
+        size_t count = 0;
+        std::vector<property> properties;
+        size_t stride = 0; //bytes per item, 0 if it has a list property and items vary in size
+    };
+
+    /**
+     * Reads the text header up to end_header
+     * @param p moved to the first byte of the body
+     * @param swap set if the file's byte order isn't this machine's
+     * @return false if it isn't a binary PLY or the header can't be read
+     */
+    static bool parse_header(const std::byte*& p, const std::byte* end, std::vector<element>& elements, bool& swap)
+    {
+        bool has_format = false;
+        bool has_end = false;
+        bool first_line = true;
+        while (p < end)
+        {
+            std::string_view line = next_line(p, end);
+            std::string_view keyword = next_word(line);
+            if (first_line)
+            {
+                if (keyword != "ply") return false;
+                first_line = false;
+            }
+            else if (keyword == "format")
+            {
+                std::string_view format = next_word(line);
+                std::endian order;
+                if (format == "binary_little_endian") order = std::endian::little;
+                else if (format == "binary_big_endian") order = std::endian::big;
+                else return false;
+                swap = order != std::endian::native;
+                has_format = true;
+            }
+            else if (keyword == "element")
+            {
+                element e;
+                e.name = next_word(line);
+                std::string_view count = next_word(line);
+                if (std::from_chars(count.data(), count.data() + count.size(), e.count).ec != std::errc()) return false;
+                elements.push_back(std::move(e));
+            }
+            else if (keyword == "property")
+            {
+                if (elements.empty()) return false;
+                property prop;
+                std::string_view type = next_word(line);
+                if (type == "list")
+                {
+                    prop.count_type = type_named(next_word(line));
+                    if (prop.count_type == scalar_type::none || prop.count_type == scalar_type::float32
+                        || prop.count_type == scalar_type::float64) return false;
+                    type = next_word(line);
+                }
+                prop.type = type_named(type);
+                prop.name = next_word(line);
+                if (prop.type == scalar_type::none) return false;
+                elements.back().properties.push_back(std::move(prop));
+            }
+            else if (keyword == "end_header")
+            {
+                has_end = true;
+                break;
+            }
+            //comment and obj_info lines are skipped
+        }
+        if (!has_format || !has_end) return false;
+
+        for (element& e : elements)
+        {
+            for (const property& prop : e.properties)
+            {
+                if (prop.count_type != scalar_type::none)
+                {
+                    e.stride = 0;
+                    break;
+                }
+                e.stride += size_of(prop.type);
+            }
+        }
+        return true;
+    }
+
+    //where x, y, z, nx, ny, nz, u, v are in a vertex
+    enum vertex_field { x, y, z, nx, ny, nz, u, v, num_fields };
+
+    static int field_named(std::string_view name)
+    {
+        if (name == "x") return x;
+        if (name == "y") return y;
+        if (name == "z") return z;
+        if (name == "nx") return nx;
+        if (name == "ny") return ny;
+        if (name == "nz") return nz;
+        //texture coords go by a few names
+        if (name == "u" || name == "s" || name == "texture_u" || name == "texture_s") return u;
+        if (name == "v" || name == "t" || name == "texture_v" || name == "texture_t") return v;
+        return -1;
+    }
+
+    static bool read_vertices(const element& e, const std::byte*& p, const std::byte* end, bool swap,
+                              std::vector<point3>& positions, std::vector<vec3>& normals, std::vector<point3>& uvs)
+    {
+        //field per property, -1 for the ones that aren't used (ex: colors, confidence)
+        std::vector<int> fields;
+        bool found[num_fields] = {};
+        for (const property& prop : e.properties)
+        {
+            int field = prop.count_type == scalar_type::none ? field_named(prop.name) : -1;
+            fields.push_back(field);
+            if (field >= 0) found[field] = true;
+        }
+        if (!found[x] || !found[y] || !found[z]) return false;
+        bool has_normals = found[nx] && found[ny] && found[nz];
+        bool has_uvs = found[u] && found[v];
+        if (e.stride > 0 && e.count > static_cast<size_t>(end - p) / e.stride) return false;
+
+        positions.resize(e.count);
+        if (has_normals) normals.resize(e.count);
+        if (has_uvs) uvs.resize(e.count);
+        real values[num_fields] = {};
+        for (size_t i = 0; i < e.count; i++)
+        {
+            for (size_t k = 0; k < e.properties.size(); k++)
+            {
+                const property& prop = e.properties[k];
+                if (prop.count_type != scalar_type::none)
+                {
+                    if (!skip_list(prop, p, end, swap)) return false;
+                    continue;
+                }
+                if (e.stride == 0 && static_cast<size_t>(end - p) < size_of(prop.type)) return false;
+                if (fields[k] >= 0) values[fields[k]] = read_as<real>(prop.type, p, swap);
+                p += size_of(prop.type);
+            }
+            positions[i] = point3(values[x], values[y], values[z]);
+            if (has_normals) normals[i] = vec3(values[nx], values[ny], values[nz]);
+            if (has_uvs) uvs[i] = point3(values[u], values[v], 0);
+        }
+        return true;
+    }
+
+    static bool read_faces(const element& e, const std::byte*& p, const std::byte* end, bool swap,
+                           size_t num_vertices, std::vector<std::uint32_t>& indices)
+    {
+        bool found = false;
+        for (const property& prop : e.properties)
+        {
+            found = found || (prop.count_type != scalar_type::none && is_index_list(prop.name));
+        }
+        if (!found) return false;
+
+        indices.reserve(indices.size() + e.count * 3); //exact for a triangle mesh, grows once for quads
+        size_t skipped = 0;
+        for (size_t i = 0; i < e.count; i++)
+        {
+            for (const property& prop : e.properties)
+            {
+                if (prop.count_type == scalar_type::none)
+                {
+                    if (static_cast<size_t>(end - p) < size_of(prop.type)) return false;
+                    p += size_of(prop.type);
+                    continue;
+                }
+                if (!is_index_list(prop.name))
+                {
+                    if (!skip_list(prop, p, end, swap)) return false;
+                    continue;
+                }
+
+                size_t count_size = size_of(prop.count_type);
+                size_t index_size = size_of(prop.type);
+                if (static_cast<size_t>(end - p) < count_size) return false;
+                auto n = read_as<std::int64_t>(prop.count_type, p, swap);
+                p += count_size;
+                if (n < 0 || static_cast<size_t>(n) > static_cast<size_t>(end - p) / index_size) return false;
+
+                //a face with an index out of range is dropped, the rest of the mesh is still fine
+                const std::byte* face = p;
+                p += n * index_size;
+                bool valid = true;
+                for (std::int64_t c = 0; c < n; c++)
+                {
+                    auto index = read_as<std::int64_t>(prop.type, face + c * index_size, swap);
+                    valid = valid && index >= 0 && static_cast<size_t>(index) < num_vertices;
+                }
+                if (!valid)
+                {
+                    skipped++;
+                    continue;
+                }
+                //triangulate as a fan around the first corner, same as obj_loader
+                auto corner = [&](std::int64_t c)
+                {
+                    return static_cast<std::uint32_t>(read_as<std::int64_t>(prop.type, face + c * index_size, swap));
+                };
+                for (std::int64_t c = 2; c < n; c++)
+                {
+                    indices.push_back(corner(0));
+                    indices.push_back(corner(c - 1));
+                    indices.push_back(corner(c));
+                }
+            }
+        }
+        if (skipped > 0) std::clog << "Skipped " << skipped << " faces with out of range vertex indices" << std::endl;
+        return true;
+    }
+
+    static bool is_index_list(const std::string& name)
+    {
+        return name == "vertex_indices" || name == "vertex_index";
+    }
+
+    //moves p past every item of an element nothing is read from (ex: edges, materials)
+    static bool skip_element(const element& e, const std::byte*& p, const std::byte* end, bool swap)
+    {
+        if (e.stride > 0)
+        {
+            if (e.count > static_cast<size_t>(end - p) / e.stride) return false;
+            p += e.count * e.stride;
+            return true;
+        }
+        for (size_t i = 0; i < e.count; i++)
+        {
+            for (const property& prop : e.properties)
+            {
+                if (prop.count_type != scalar_type::none)
+                {
+                    if (!skip_list(prop, p, end, swap)) return false;
+                }
+                else
+                {
+                    if (static_cast<size_t>(end - p) < size_of(prop.type)) return false;
+                    p += size_of(prop.type);
+                }
+            }
+        }
+        return true;
+    }
+
+    static bool skip_list(const property& prop, const std::byte*& p, const std::byte* end, bool swap)
+    {
+        size_t count_size = size_of(prop.count_type);
+        if (static_cast<size_t>(end - p) < count_size) return false;
+        auto n = read_as<std::int64_t>(prop.count_type, p, swap);
+        p += count_size;
+        if (n < 0 || static_cast<size_t>(n) > static_cast<size_t>(end - p) / size_of(prop.type)) return false;
+        p += n * size_of(prop.type);
+        return true;
+    }
+
+    static scalar_type type_named(std::string_view name)
+    {
+        //both the old and the sized names are in use
+        if (name == "char" || name == "int8") return scalar_type::int8;
+        if (name == "uchar" || name == "uint8") return scalar_type::uint8;
+        if (name == "short" || name == "int16") return scalar_type::int16;
+        if (name == "ushort" || name == "uint16") return scalar_type::uint16;
+        if (name == "int" || name == "int32") return scalar_type::int32;
+        if (name == "uint" || name == "uint32") return scalar_type::uint32;
+        if (name == "float" || name == "float32") return scalar_type::float32;
+        if (name == "double" || name == "float64") return scalar_type::float64;
+        return scalar_type::none;
+    }
+
+    static size_t size_of(scalar_type type)
+    {
+        switch (type)
+        {
+            case scalar_type::int8: case scalar_type::uint8: return 1;
+            case scalar_type::int16: case scalar_type::uint16: return 2;
+            case scalar_type::int32: case scalar_type::uint32: case scalar_type::float32: return 4;
+            case scalar_type::float64: return 8;
+            default: return 0;
+        }
+    }
+
+    //the body isn't aligned, so values are copied out instead of read through a pointer
+    template <typename T>
+    static T load_scalar(const std::byte* p, bool swap)
+    {
+        std::byte bytes[sizeof(T)];
+        std::memcpy(bytes, p, sizeof(T));
+        if (swap) std::reverse(bytes, bytes + sizeof(T));
+        T value;
+        std::memcpy(&value, bytes, sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    static T read_as(scalar_type type, const std::byte* p, bool swap)
+    {
+        switch (type)
+        {
+            case scalar_type::int8: return static_cast<T>(load_scalar<std::int8_t>(p, swap));
+            case scalar_type::uint8: return static_cast<T>(load_scalar<std::uint8_t>(p, swap));
+            case scalar_type::int16: return static_cast<T>(load_scalar<std::int16_t>(p, swap));
+            case scalar_type::uint16: return static_cast<T>(load_scalar<std::uint16_t>(p, swap));
+            case scalar_type::int32: return static_cast<T>(load_scalar<std::int32_t>(p, swap));
+            case scalar_type::uint32: return static_cast<T>(load_scalar<std::uint32_t>(p, swap));
+            case scalar_type::float32: return static_cast<T>(load_scalar<float>(p, swap));
+            case scalar_type::float64: return static_cast<T>(load_scalar<double>(p, swap));
+            default: return T();
+        }
+    }
+
+    //the header line at p (without the newline), and p moved to the next one
+    static std::string_view next_line(const std::byte*& p, const std::byte* end)
+    {
+        const char* start = reinterpret_cast<const char*>(p);
+        const char* stop = start;
+        const char* limit = reinterpret_cast<const char*>(end);
+        while (stop < limit && *stop != '\n') stop++;
+        p = reinterpret_cast<const std::byte*>(stop < limit ? stop + 1 : stop);
+        if (stop > start && stop[-1] == '\r') stop--;
+        return std::string_view(start, stop - start);
+    }
+
+    //the first space separated word of line, which is moved past it
+    static std::string_view next_word(std::string_view& line)
+    {
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string_view::npos)
+        {
+            line = {};
+            return {};
+        }
+        size_t stop = line.find_first_of(" \t", start);
+        if (stop == std::string_view::npos) stop = line.size();
+        std::string_view word = line.substr(start, stop - start);
+        line.remove_prefix(stop);
+        return word;
+    }
+};
+
+#endif //PLY_LOADER_H
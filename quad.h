@@ -11,7 +11,7 @@
 class quad : public hittable
 {
 public:
-    quad(const point3& Q, const vec3& u, const vec3& v, const shared_ptr<material>& mat) :
+    quad(const point3& Q, const vec3& u, const vec3& v, material_id mat) :
     Q(Q), u(u), v(v), mat(mat)
     {
         vec3 n = cross(u, v);
@@ -34,7 +34,7 @@ public:
         if (std::fabs(denom) < 1e-8) return false; //ray is parallel to the plane
 
         auto t = (D - dot(normal, r.origin()))/denom;
-        if (!ray_t.contains(t)) return false; //intersection time is outside valid interval
+        if (!ray_t.surrounds(t)) return false; //intersection time is outside valid interval
 
         auto hit_point = r.at(t);
         auto p = hit_point - Q;
@@ -49,53 +49,40 @@ public:
         }
 
         rec.t = t;
-        rec.p = r.at(t);
+        //project the hit back onto the plane so its error doesn't depend on t (pbrt 6.8.5)
+        rec.p = hit_point - (dot(normal, hit_point) - D) * normal;
+        rec.p_error = error_gamma(8) * (abs(rec.p) + std::fabs(D) * abs(normal));
         rec.set_face_normal(r, normal);
         rec.mat = mat;
         rec.incident_eta = r.current_ior();
 
         return true;
     }
-    vec3 get_random_point()
+    vec3 get_random_point() const
     {
         return Q + random_double() * u + random_double() * v;
     }
-    double get_area()
+    real get_area() const
     {
         return cross(u, v).length();
     }
-    vec3 n()
+    vec3 n() const
     {
         return normal;
     }
+    material_id get_material() const
+    {
+        return mat;
+    }
 private:
     point3 Q;
     vec3 u;
     vec3 v;
     vec3 w;
-    shared_ptr<material> mat;
+    material_id mat;
     aabb bbox;
     vec3 normal;
-    double D;
+    real D;
 };
-inline shared_ptr<hittable_list> box(const point3& a, const point3& b, shared_ptr<material> mat)
-{
-    //Returns the 3d box (6 sides) that contains a and b as max points
-    auto sides = make_shared<hittable_list>();
-    auto min = point3(std::fmin(a.x(), b.x()), std::fmin(a.y(), b.y()), std::fmin(a.z(), b.z()));
-    auto max = point3(std::fmax(a.x(), b.x()), std::fmax(a.y(), b.y()), std::fmax(a.z(), b.z()));
-
-    auto dx = vec3(max.x() - min.x(), 0, 0);
-    auto dy = vec3(0, max.y() - min.y(), 0);
-    auto dz = vec3(0, 0, max.z() - min.z());
-    sides->add(make_shared<quad>(min, dx, dy, mat));
-    sides->add(make_shared<quad>(min, dy, dz, mat));
-    sides->add(make_shared<quad>(min, dx, dz, mat));
-    sides->add(make_shared<quad>(max, -dx, -dy, mat));
-    sides->add(make_shared<quad>(max, -dy, -dz, mat));
-    sides->add(make_shared<quad>(max, -dx, -dz, mat));
-
-    return sides;
-}
 
 #endif //QUAD_H
@@ -0,0 +1,146 @@
+//
+// Created by Faye Yu on 1/13/26.
+//
+
+#ifndef QUANTIZATION_H
+#define QUANTIZATION_H
+
+#include <algorithm>
+#include <cstdint>
+#include "aabb.h"
+
+//compact encodings for mesh vertex attributes, decoded whenever a ray or shading needs them
+
+class position_quantizer
+{
+/*
+ * positions as 21 bit fixed point per axis relative to the mesh bounds, packed into one uint64 (63 bits used).
+ * decoding always gives back the exact same point, so the mesh is consistent with itself,
+ * and the max error is half a step: extent / 2^22 per axis
+ */
+public:
+    static constexpr int bits = 21;
+    static constexpr std::uint64_t max_q = (std::uint64_t(1) << bits) - 1;
+
+    position_quantizer() = default;
+    explicit position_quantizer(const aabb& bounds)
+    {
+        for (int a = 0; a < 3; a++)
+        {
+            const interval& extent = bounds.axis_interval(a);
+            origin[a] = extent.min;
+            step[a] = extent.size() > 0 ? extent.size() / static_cast<real>(max_q) : 0;
+        }
+    }
+
+    std::uint64_t encode(const point3& p) const
+    {
+        std::uint64_t packed = 0;
+        for (int a = 0; a < 3; a++)
+        {
+            std::uint64_t q = 0;
+            if (step[a] > 0)
+            {
+                real scaled = std::round((p[a] - origin[a]) / step[a]);
+                q = static_cast<std::uint64_t>(std::clamp<real>(scaled, 0, static_cast<real>(max_q)));
+            }
+            packed |= q << (bits * a);
+        }
+        return packed;
+    }
+    point3 decode(std::uint64_t packed) const
+    {
+        point3 p;
+        for (int a = 0; a < 3; a++)
+        {
+            auto q = static_cast<real>((packed >> (bits * a)) & max_q);
+            p[a] = origin[a] + q * step[a];
+        }
+        return p;
+    }
+private:
+    point3 origin;
+    vec3 step;
+};
+
+class uv_quantizer
+{
+/*
+ * texture coords as 16 bit fixed point relative to the mesh's uv bounds (they aren't always in [0, 1]),
+ * u in the low half of a uint32 and v in the high half
+ */
+public:
+    static constexpr std::uint32_t max_q = 0xffff;
+
+    uv_quantizer() = default;
+    uv_quantizer(real u_min, real u_max, real v_min, real v_max) : u_min(u_min), v_min(v_min)
+    {
+        u_step = u_max > u_min ? (u_max - u_min) / max_q : 0;
+        v_step = v_max > v_min ? (v_max - v_min) / max_q : 0;
+    }
+
+    std::uint32_t encode(real u, real v) const
+    {
+        return quantize(u, u_min, u_step) | (quantize(v, v_min, v_step) << 16);
+    }
+    //returns (u, v, 0) like the vt values obj_loader reads
+    point3 decode(std::uint32_t packed) const
+    {
+        return point3(u_min + static_cast<real>(packed & max_q) * u_step,
+                      v_min + static_cast<real>(packed >> 16) * v_step, 0);
+    }
+private:
+    real u_min = 0, v_min = 0;
+    real u_step = 0, v_step = 0;
+
+    static std::uint32_t quantize(real x, real min, real step)
+    {
+        if (step <= 0) return 0;
+        return static_cast<std::uint32_t>(std::clamp<real>(std::round((x - min) / step), 0, max_q));
+    }
+};
+
+/*
+ * unit vectors in 32 bits with the octahedral mapping (Cigolle et al. 2014, "A Survey of Efficient Representations
+ * for Independent Unit Vectors"): project onto the octahedron |x|+|y|+|z| = 1, fold the lower half over the upper,
+ * and store the 2d point as two 16 bit snorms. worst case error is around 0.005 degrees
+ */
+inline real sign_not_zero(real x) { return x < 0 ? -1 : 1; }
+
+inline std::uint32_t encode_octahedral(const vec3& n)
+{
+    real l1 = std::fabs(n.x()) + std::fabs(n.y()) + std::fabs(n.z());
+    if (l1 == 0) return 0;
+    real x = n.x() / l1;
+    real y = n.y() / l1;
+    if (n.z() < 0)
+    {
+        real folded_x = (1 - std::fabs(y)) * sign_not_zero(x);
+        real folded_y = (1 - std::fabs(x)) * sign_not_zero(y);
+        x = folded_x;
+        y = folded_y;
+    }
+    auto snorm16 = [](real f)
+    {
+        auto q = static_cast<std::int16_t>(std::round(std::clamp<real>(f, -1, 1) * 32767));
+        return static_cast<std::uint32_t>(static_cast<std::uint16_t>(q));
+    };
+    return snorm16(x) | (snorm16(y) << 16);
+}
+
+inline vec3 decode_octahedral(std::uint32_t packed)
+{
+    real x = static_cast<std::int16_t>(packed & 0xffff) / real(32767);
+    real y = static_cast<std::int16_t>(packed >> 16) / real(32767);
+    real z = 1 - std::fabs(x) - std::fabs(y);
+    if (z < 0)
+    {
+        real unfolded_x = (1 - std::fabs(y)) * sign_not_zero(x);
+        real unfolded_y = (1 - std::fabs(x)) * sign_not_zero(y);
+        x = unfolded_x;
+        y = unfolded_y;
+    }
+    return unit_vector(vec3(x, y, z));
+}
+
+#endif //QUANTIZATION_H
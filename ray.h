@@ -7,31 +7,34 @@
 
 #include "vec3.h"
 
-class ray {
+template <typename T>
+class basic_ray {
 public:
-    ray() {}
+    basic_ray() {}
 
-    ray(const point3& origin, const vec3& direction) : orig(origin), dir(direction)
+    basic_ray(const basic_vec3<T>& origin, const basic_vec3<T>& direction) : orig(origin), dir(direction)
     {
         eta = 1.0; //for air
     }
 
-    const point3& origin() const {return orig;}
-    const vec3& direction() const {return dir;}
-    double current_ior() const {return eta;}
-    void set_eta(const double e)
+    const basic_vec3<T>& origin() const {return orig;}
+    const basic_vec3<T>& direction() const {return dir;}
+    T current_ior() const {return eta;}
+    void set_eta(const T e)
     {
         eta = e;
     }
 
-    point3 at(double t) const {
+    basic_vec3<T> at(T t) const {
         return orig + t*dir;
     }
 
 private:
-    point3 orig;
-    vec3 dir;
-    double eta; //ior of current medium you're in
+    basic_vec3<T> orig;
+    basic_vec3<T> dir;
+    T eta; //ior of current medium you're in
 };
 
+using ray = basic_ray<real>;
+
 #endif //RAY_H
@@ -16,11 +16,28 @@
 using std::make_shared;
 using std::shared_ptr;
 
+//scalar type for geometry and traversal (vec3, ray, interval, aabb and the primitives).
+//color is a vec3 too, so it's float as well. shading code keeps its own scalars (pdfs, cosines) in double
+//configure with -DRT_FLOAT=ON to render in single precision
+#ifdef RT_FLOAT
+using real = float;
+#else
+using real = double;
+#endif
+
 //constants
 const double infinity = std::numeric_limits<double>::infinity();
 const double pi = 3.1415926535897932385;
 
+//half of the gap between 1 and the next representable real, the bound on relative rounding error
+constexpr real machine_epsilon = std::numeric_limits<real>::epsilon() * 0.5;
+
 //utility funcs
+constexpr real error_gamma(int n)
+{
+    //bounds the relative error of n chained floating point ops (pbrt 6.8.1)
+    return (n * machine_epsilon) / (1 - n * machine_epsilon);
+}
 inline double degrees_to_radians(double degrees)
 {
     return degrees * pi / 180.0;
@@ -42,9 +59,15 @@ inline double random_double(double min, double max){
 inline int random_int(int min, int max)
 {
     //returns a random int in [min, max]
+    //the range is passed on every call, a static distribution would keep the first call's [min, max] forever
     static std::mt19937 generator (std::random_device{}());
-    static std::uniform_int_distribution<> distribution(min, max);
-    return distribution(generator);
+    static std::uniform_int_distribution<> distribution;
+    return distribution(generator, std::uniform_int_distribution<>::param_type(min, max));
+}
+inline void hash_combine(std::size_t& seed, double v)
+{
+    //mixes the hash of v into seed (boost::hash_combine)
+    seed ^= std::hash<double>{}(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
 }
 //common headers
 #include "color.h"
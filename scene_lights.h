@@ -0,0 +1,178 @@
+//
+// Created by Faye Yu on 1/24/26.
+//
+
+#ifndef SCENE_LIGHTS_H
+#define SCENE_LIGHTS_H
+
+#include <cstdlib>
+#include <set>
+#include <string>
+#include <typeindex>
+#include <typeinfo>
+#include <vector>
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#endif
+#include "box.h"
+#include "bvh_node.h"
+#include "hittable_list.h"
+#include "light.h"
+#include "material_registry.h"
+#include "sphere_set.h"
+#include "tessellated_mesh.h"
+#include "transform.h"
+
+class scene_lights
+{
+public:
+    /**
+     * Finds every emissive quad, triangle, sphere, box and mesh in the scene and makes it a light, so next event estimation
+     * samples it instead of waiting for bsdf rays to hit it. walks through hittable_lists and bvh_nodes.
+     * emissive geometry it can't sample (ex: a tessellated_mesh) is logged, only bsdf rays find it.
+     * hittable types it doesn't know (ex: one added outside this repo) are never lights, since there's no telling
+     * what material they use. each such type is logged once
+     * @param world
+     * @param materials decides what emits: anything whose material has a non-black emitted()
+     * @return the lights, ready for camera::render
+     */
+    static std::vector<shared_ptr<light>> find(const hittable& world, const material_registry& materials)
+    {
+        std::vector<shared_ptr<light>> lights;
+        std::set<std::type_index> unknown;
+        if (!add_children(world, materials, lights, unknown))
+        {
+            std::clog << "scene_lights: the world isn't a hittable_list or bvh_node, no lights found\n";
+        }
+        for (const std::type_index& type : unknown)
+        {
+            std::clog << "scene_lights: can't tell if a " << readable_name(type) << " emits, it isn't sampled as a light\n";
+        }
+        return lights;
+    }
+private:
+    static bool emits(const material_registry& materials, material_id id)
+    {
+        return !materials[id].emitted().near_zero();
+    }
+
+    //false if object doesn't hold other hittables
+    static bool add_children(const hittable& object, const material_registry& materials, std::vector<shared_ptr<light>>& lights,
+                             std::set<std::type_index>& unknown)
+    {
+        if (auto list = dynamic_cast<const hittable_list*>(&object))
+        {
+            for (const auto& child : list->objects) add(child, materials, lights, unknown);
+            return true;
+        }
+        if (auto node = dynamic_cast<const bvh_node*>(&object))
+        {
+            add(node->left_child(), materials, lights, unknown);
+            add(node->right_child(), materials, lights, unknown);
+            return true;
+        }
+        if (auto xf = dynamic_cast<const transform*>(&object))
+        {
+            //lights sample in world space, they'd need to know the transform
+            std::vector<shared_ptr<light>> inside;
+            add(xf->inner(), materials, inside, unknown);
+            if (!inside.empty()) std::clog << "scene_lights: emissive geometry inside a transform isn't sampled as a light, only bsdf rays find it\n";
+            return true;
+        }
+        return false;
+    }
+
+    //types it doesn't know go into unknown
+    static void add(const shared_ptr<hittable>& object, const material_registry& materials, std::vector<shared_ptr<light>>& lights,
+                    std::set<std::type_index>& unknown)
+    {
+        if (add_children(*object, materials, lights, unknown)) return;
+
+        if (auto q = std::dynamic_pointer_cast<quad>(object))
+        {
+            material_id id = q->get_material();
+            if (emits(materials, id)) lights.push_back(make_shared<quad_light>(q, materials[id]));
+        }
+        else if (auto tri = std::dynamic_pointer_cast<triangle>(object))
+        {
+            material_id id = tri->get_material();
+            if (emits(materials, id)) lights.push_back(make_shared<triangle_light>(tri, materials[id]));
+        }
+        else if (auto s = std::dynamic_pointer_cast<sphere>(object))
+        {
+            material_id id = s->get_material();
+            if (emits(materials, id)) lights.push_back(make_shared<sphere_light>(s->get_center(), s->get_radius(), id, materials[id]));
+        }
+        else if (auto set = std::dynamic_pointer_cast<sphere_set>(object))
+        {
+            for (size_t i = 0; i < set->size(); i++)
+            {
+                material_id id = set->material_of(i);
+                if (emits(materials, id)) lights.push_back(make_shared<sphere_light>(set->center(i), set->radius(i), id, materials[id]));
+            }
+        }
+        else if (auto b = std::dynamic_pointer_cast<box>(object))
+        {
+            //one quad light per face
+            material_id id = b->get_material();
+            if (emits(materials, id))
+            {
+                for (const auto& face : box_faces(*b)) lights.push_back(make_shared<quad_light>(face, materials[id]));
+            }
+        }
+        else if (auto mesh = std::dynamic_pointer_cast<triangle_mesh>(object))
+        {
+            //one light per emissive material slot, triangles picked by area within it
+            for (std::uint32_t slot = 0; slot < mesh->num_material_slots(); slot++)
+            {
+                material_id id = mesh->slot_material(slot);
+                if (!emits(materials, id)) continue;
+                auto l = make_shared<mesh_light>(mesh, slot, materials[id]);
+                if (!l->empty()) lights.push_back(l);
+            }
+        }
+        else if (auto tess = std::dynamic_pointer_cast<tessellated_mesh>(object))
+        {
+            //its triangles only exist once rays reach them
+            if (emits(materials, tess->get_material())) std::clog << "scene_lights: an emissive tessellated_mesh isn't sampled as a light, only bsdf rays find it\n";
+        }
+        else unknown.insert(typeid(*object));
+    }
+
+    static std::string readable_name(const std::type_index& type)
+    {
+#if defined(__GNUG__)
+        int status = 0;
+        char* demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+        if (status == 0 && demangled)
+        {
+            std::string name = demangled;
+            std::free(demangled);
+            return name;
+        }
+#endif
+        return type.name();
+    }
+
+    //the box's faces, each facing out of it. faces of a flat box with no area are left out
+    static std::vector<shared_ptr<quad>> box_faces(const box& b)
+    {
+        point3 lo = b.min_corner(), hi = b.max_corner();
+        vec3 dx(hi.x() - lo.x(), 0, 0), dy(0, hi.y() - lo.y(), 0), dz(0, 0, hi.z() - lo.z());
+        material_id mat = b.get_material();
+        std::vector<shared_ptr<quad>> faces;
+        auto add_face = [&](const point3& q, const vec3& u, const vec3& v)
+        {
+            if (!cross(u, v).near_zero()) faces.push_back(make_shared<quad>(q, u, v, mat));
+        };
+        add_face(lo, dz, dy); //-x
+        add_face(point3(hi.x(), lo.y(), lo.z()), dy, dz); //+x
+        add_face(lo, dx, dz); //-y
+        add_face(point3(lo.x(), hi.y(), lo.z()), dz, dx); //+y
+        add_face(lo, dy, dx); //-z
+        add_face(point3(lo.x(), lo.y(), hi.z()), dx, dy); //+z
+        return faces;
+    }
+};
+
+#endif //SCENE_LIGHTS_H
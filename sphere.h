@@ -9,7 +9,7 @@
 
 class sphere : public hittable{
 public:
-    sphere(const point3& center, double radius, const shared_ptr<material>& mat)
+    sphere(const point3& center, real radius, material_id mat)
     : center(center), radius(std::fmax(0, radius)), mat(mat)
     {
         //Stationary sphere
@@ -44,8 +44,12 @@ public:
         }
 
         rec.t = root;
-        rec.p = r.at(rec.t);
-        vec3 outward_normal = (rec.p - center) / radius;
+        //refine p by projecting it back onto the sphere, so its error doesn't depend on t (pbrt 6.8.5)
+        vec3 offset = r.at(rec.t) - center;
+        offset *= radius / offset.length();
+        rec.p = center + offset;
+        rec.p_error = error_gamma(5) * abs(offset) + error_gamma(1) * abs(rec.p);
+        vec3 outward_normal = offset / radius;
         rec.set_face_normal(r, outward_normal);
         rec.mat = mat;
         rec.incident_eta = r.current_ior();
@@ -53,10 +57,13 @@ public:
         return true;
     }
     aabb bounding_box() const override {return bbox;};
+    point3 get_center() const { return center; }
+    real get_radius() const { return radius; }
+    material_id get_material() const { return mat; }
 private:
     point3 center;
-    double radius;
-    shared_ptr<material> mat;
+    real radius;
+    material_id mat;
     aabb bbox;
 };
 
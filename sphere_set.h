@@ -0,0 +1,219 @@
+//
+// Created by Faye Yu on 1/8/26.
+//
+
+#ifndef SPHERE_SET_H
+#define SPHERE_SET_H
+
+#include "flat_bvh.h"
+#include "hittable.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+class sphere_set : public hittable
+{
+/*
+ * lots of small spheres (ex: particles) as one primitive.
+ * centers and radii are stored as float arrays (structure of arrays) in bvh leaf order,
+ * so each leaf is a contiguous run of at most 8 spheres that gets tested with one set of AVX2 instructions.
+ * the closest candidate is then re-solved in real precision so hit points are as accurate as sphere::hit
+ */
+public:
+    static constexpr std::uint32_t lanes = 8;
+
+    void add(const point3& center, real radius, material_id mat)
+    {
+        cx.push_back(static_cast<float>(center.x()));
+        cy.push_back(static_cast<float>(center.y()));
+        cz.push_back(static_cast<float>(center.z()));
+        radii.push_back(static_cast<float>(std::fmax(0, radius)));
+        mats.push_back(mat);
+
+        //from what was stored, the float rounded center and clamped radius are what rays get tested against
+        bbox = aabb(bbox, sphere_bounds(cx.size() - 1));
+    }
+
+    //call once every sphere is added, before the set goes into a scene
+    void build()
+    {
+        size_t n = mats.size();
+        std::vector<aabb> bounds;
+        bounds.reserve(n);
+        for (size_t i = 0; i < n; i++) bounds.push_back(sphere_bounds(i));
+        bvh.build(bounds, lanes);
+
+        //store spheres in leaf order so leaf ranges index the arrays directly
+        permute(cx);
+        permute(cy);
+        permute(cz);
+        permute(radii);
+        permute(mats);
+        bvh.prim_indices.clear();
+        bvh.prim_indices.shrink_to_fit();
+
+        //pad so an 8 wide load at the last leaf never reads past the end, the lanes get masked off anyway
+        for (auto* arr : {&cx, &cy, &cz, &radii}) arr->resize(n + lanes - 1, 0.0f);
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    {
+        return bvh.traverse(r, ray_t, [&](std::uint32_t first, std::uint32_t count, interval& t)
+        {
+            if (!hit_leaf(r, first, count, t, rec)) return false;
+            t.max = rec.t;
+            return true;
+        });
+    }
+
+    aabb bounding_box() const override { return bbox; }
+    size_t size() const { return mats.size(); }
+    //sphere i, in the order build() left them
+    point3 center(size_t i) const { return point3(cx[i], cy[i], cz[i]); }
+    real radius(size_t i) const { return radii[i]; }
+    material_id material_of(size_t i) const { return mats[i]; }
+private:
+    std::vector<float> cx, cy, cz, radii;
+    std::vector<material_id> mats;
+    flat_bvh bvh;
+    aabb bbox;
+
+    aabb sphere_bounds(size_t i) const
+    {
+        auto c = point3(cx[i], cy[i], cz[i]);
+        auto rvec = vec3(radii[i], radii[i], radii[i]);
+        return aabb(c - rvec, c + rvec);
+    }
+
+    template <typename T>
+    void permute(std::vector<T>& arr) const
+    {
+        std::vector<T> sorted(arr.size());
+        for (size_t i = 0; i < sorted.size(); i++) sorted[i] = arr[bvh.prim_indices[i]];
+        arr = std::move(sorted);
+    }
+
+    //returns a bitmask of the lanes whose sphere is hit inside ray_t, and their float hit times
+    std::uint32_t candidates(const ray& r, std::uint32_t first, std::uint32_t count, const interval& ray_t, float t_out[lanes]) const
+    {
+        float ox = static_cast<float>(r.origin().x());
+        float oy = static_cast<float>(r.origin().y());
+        float oz = static_cast<float>(r.origin().z());
+        float dx = static_cast<float>(r.direction().x());
+        float dy = static_cast<float>(r.direction().y());
+        float dz = static_cast<float>(r.direction().z());
+        float a = dx*dx + dy*dy + dz*dz;
+        float t_min = static_cast<float>(ray_t.min);
+        float t_max = static_cast<float>(ray_t.max);
+#if defined(__AVX2__)
+        //sphere::hit, 8 spheres at a time
+        __m256 ocx = _mm256_sub_ps(_mm256_loadu_ps(&cx[first]), _mm256_set1_ps(ox));
+        __m256 ocy = _mm256_sub_ps(_mm256_loadu_ps(&cy[first]), _mm256_set1_ps(oy));
+        __m256 ocz = _mm256_sub_ps(_mm256_loadu_ps(&cz[first]), _mm256_set1_ps(oz));
+        __m256 rad = _mm256_loadu_ps(&radii[first]);
+
+        __m256 h = _mm256_mul_ps(_mm256_set1_ps(dx), ocx);
+        h = _mm256_fmadd_ps(_mm256_set1_ps(dy), ocy, h);
+        h = _mm256_fmadd_ps(_mm256_set1_ps(dz), ocz, h);
+        //discriminant as a*(r^2 - |l|^2), where l is oc minus its projection on the ray.
+        //h*h - a*c cancels badly in float when the ray starts far from a small sphere (ray tracing gems ch 7)
+        __m256 vec_a = _mm256_set1_ps(a);
+        __m256 s = _mm256_div_ps(h, vec_a);
+        __m256 lx = _mm256_fnmadd_ps(s, _mm256_set1_ps(dx), ocx);
+        __m256 ly = _mm256_fnmadd_ps(s, _mm256_set1_ps(dy), ocy);
+        __m256 lz = _mm256_fnmadd_ps(s, _mm256_set1_ps(dz), ocz);
+        __m256 l2 = _mm256_mul_ps(lx, lx);
+        l2 = _mm256_fmadd_ps(ly, ly, l2);
+        l2 = _mm256_fmadd_ps(lz, lz, l2);
+        __m256 discriminant = _mm256_mul_ps(vec_a, _mm256_fmsub_ps(rad, rad, l2));
+        __m256 valid = _mm256_cmp_ps(discriminant, _mm256_setzero_ps(), _CMP_GE_OQ);
+        __m256 sqrtd = _mm256_sqrt_ps(_mm256_max_ps(discriminant, _mm256_setzero_ps()));
+
+        //nearest root inside the interval, else the far root
+        __m256 vec_t_min = _mm256_set1_ps(t_min);
+        __m256 near_root = _mm256_div_ps(_mm256_sub_ps(h, sqrtd), vec_a);
+        __m256 far_root = _mm256_div_ps(_mm256_add_ps(h, sqrtd), vec_a);
+        __m256 use_near = _mm256_cmp_ps(near_root, vec_t_min, _CMP_GT_OQ);
+        __m256 root = _mm256_blendv_ps(far_root, near_root, use_near);
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(root, vec_t_min, _CMP_GT_OQ));
+        valid = _mm256_and_ps(valid, _mm256_cmp_ps(root, _mm256_set1_ps(t_max), _CMP_LT_OQ));
+
+        _mm256_storeu_ps(t_out, root);
+        auto mask = static_cast<std::uint32_t>(_mm256_movemask_ps(valid));
+#else
+        std::uint32_t mask = 0;
+        for (std::uint32_t lane = 0; lane < lanes; lane++)
+        {
+            float ocx = cx[first + lane] - ox;
+            float ocy = cy[first + lane] - oy;
+            float ocz = cz[first + lane] - oz;
+            float h = dx*ocx + dy*ocy + dz*ocz;
+            float s = h / a;
+            float lx = ocx - s*dx, ly = ocy - s*dy, lz = ocz - s*dz;
+            float discriminant = a * (radii[first + lane]*radii[first + lane] - (lx*lx + ly*ly + lz*lz));
+            if (discriminant < 0) continue;
+            float sqrtd = std::sqrt(discriminant);
+            float root = (h - sqrtd) / a;
+            if (root <= t_min) root = (h + sqrtd) / a;
+            if (root <= t_min || root >= t_max) continue;
+            t_out[lane] = root;
+            mask |= 1u << lane;
+        }
+#endif
+        return mask & ((1u << count) - 1); //lanes past the end of the leaf belong to the next leaf
+    }
+
+    bool hit_leaf(const ray& r, std::uint32_t first, std::uint32_t count, const interval& ray_t, hit_record& rec) const
+    {
+        alignas(32) float t[lanes];
+        std::uint32_t mask = candidates(r, first, count, ray_t, t);
+        while (mask)
+        {
+            //take the closest candidate, and drop it if full precision disagrees that it's a hit
+            std::uint32_t best = lanes;
+            for (std::uint32_t lane = 0; lane < lanes; lane++)
+            {
+                if ((mask >> lane & 1u) && (best == lanes || t[lane] < t[best])) best = lane;
+            }
+            if (hit_sphere(r, first + best, ray_t, rec)) return true;
+            mask &= ~(1u << best);
+        }
+        return false;
+    }
+
+    bool hit_sphere(const ray& r, std::uint32_t i, const interval& ray_t, hit_record& rec) const
+    {
+        auto center = point3(cx[i], cy[i], cz[i]);
+        real radius = radii[i];
+        vec3 oc = center - r.origin();
+        auto a = r.direction().length_squared();
+        auto h = dot(r.direction(), oc);
+        auto c = oc.length_squared() - radius * radius;
+
+        auto discriminant = h*h - a*c;
+        if (discriminant < 0) return false;
+
+        auto sqrtd = std::sqrt(discriminant);
+        auto root = (h - sqrtd) / a;
+        if (!ray_t.surrounds(root))
+        {
+            root = (h + sqrtd)/a;
+            if (!ray_t.surrounds(root))
+                return false;
+        }
+
+        rec.t = root;
+        vec3 offset = r.at(rec.t) - center;
+        offset *= radius / offset.length();
+        rec.p = center + offset;
+        rec.p_error = error_gamma(5) * abs(offset) + error_gamma(1) * abs(rec.p);
+        vec3 outward_normal = offset / radius;
+        rec.set_face_normal(r, outward_normal);
+        rec.mat = mats[i];
+        rec.incident_eta = r.current_ior();
+        return true;
+    }
+};
+
+#endif //SPHERE_SET_H
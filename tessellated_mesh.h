@@ -0,0 +1,162 @@
+//
+// Created by Faye Yu on 1/12/26.
+//
+
+#ifndef TESSELLATED_MESH_H
+#define TESSELLATED_MESH_H
+
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include "bvh_node.h"
+#include "geometry_cache.h"
+#include "triangle.h"
+
+class tessellated_mesh : public hittable
+{
+/*
+ * displaced/subdivided surface that only keeps its coarse control mesh in memory.
+ * each control triangle is a patch with a conservative bbox (the triangle grown by the max displacement).
+ * the first time a ray enters a patch's bbox the patch is tessellated and gets its own bvh,
+ * which lives in a geometry_cache that can be shared by many meshes and evicts cold patches when over budget
+ */
+public:
+    //returns how far to push point p out along the (unit) normal n
+    using displacement_fn = std::function<real(const point3& p, const vec3& n)>;
+
+    /**
+     * @param control_points vertices of the coarse control mesh
+     * @param indices 3 per control triangle, CCW
+     * @param subdivision_level each control triangle becomes 4^subdivision_level triangles
+     * @param displacement applied to every tessellated vertex
+     * @param max_displacement bound on |displacement|, used to size the patch bboxes
+     * @param cache where tessellated patches live, pass the same cache to every mesh that shares a memory budget
+     */
+    tessellated_mesh(std::vector<point3> control_points, std::vector<std::uint32_t> indices, material_id mat,
+                     int subdivision_level, displacement_fn displacement, real max_displacement,
+                     shared_ptr<geometry_cache> cache) :
+    points(std::move(control_points)), indices(std::move(indices)), mat(mat), level(subdivision_level),
+    displacement(std::move(displacement)), cache(std::move(cache))
+    {
+        compute_vertex_normals();
+
+        hittable_list patches;
+        auto pad = vec3(max_displacement, max_displacement, max_displacement);
+        for (std::uint32_t face = 0; face < this->indices.size() / 3; face++)
+        {
+            const point3& p0 = points[this->indices[3*face]];
+            const point3& p1 = points[this->indices[3*face + 1]];
+            const point3& p2 = points[this->indices[3*face + 2]];
+            point3 lo, hi;
+            for (int a = 0; a < 3; a++)
+            {
+                lo[a] = std::fmin(p0[a], std::fmin(p1[a], p2[a]));
+                hi[a] = std::fmax(p0[a], std::fmax(p1[a], p2[a]));
+            }
+            aabb bbox = aabb(lo - pad, hi + pad);
+            patches.add(make_shared<patch>(this, face, bbox));
+        }
+        //the bvh over patches only needs their bboxes, nothing gets tessellated here
+        bvh = make_shared<bvh_node>(patches);
+    }
+    //patches point back at their mesh, so the mesh can't move
+    tessellated_mesh(const tessellated_mesh&) = delete;
+    tessellated_mesh& operator=(const tessellated_mesh&) = delete;
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    {
+        return bvh->hit(r, ray_t, rec);
+    }
+    aabb bounding_box() const override { return bvh->bounding_box(); }
+    material_id get_material() const { return mat; }
+private:
+    class patch : public hittable
+    {
+    public:
+        patch(const tessellated_mesh* mesh, std::uint32_t face, const aabb& bbox) : mesh(mesh), face(face), bbox(bbox) {}
+
+        bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+        {
+            //bvh_node hits its children without checking their boxes, so check ours before tessellating
+            if (!bbox.hit(r, ray_t)) return false;
+            shared_ptr<hittable> geometry = mesh->cache->get(this, [this]{ return mesh->tessellate(face); });
+            return geometry->hit(r, ray_t, rec);
+        }
+        aabb bounding_box() const override { return bbox; }
+    private:
+        const tessellated_mesh* mesh;
+        std::uint32_t face;
+        aabb bbox;
+    };
+
+    std::vector<point3> points;
+    std::vector<vec3> normals; //per control vertex, averaged from the faces around it
+    std::vector<std::uint32_t> indices;
+    material_id mat;
+    int level;
+    displacement_fn displacement;
+    shared_ptr<geometry_cache> cache;
+    shared_ptr<bvh_node> bvh;
+
+    void compute_vertex_normals()
+    {
+        normals.assign(points.size(), vec3(0, 0, 0));
+        for (size_t i = 0; i + 2 < indices.size(); i += 3)
+        {
+            //area weighted, the cross product's length is twice the area
+            vec3 n = cross(points[indices[i+1]] - points[indices[i]], points[indices[i+2]] - points[indices[i]]);
+            for (int k = 0; k < 3; k++) normals[indices[i+k]] += n;
+        }
+        for (vec3& n : normals)
+        {
+            if (n.length_squared() > 0) n = unit_vector(n);
+        }
+    }
+
+    geometry_cache::built_geometry tessellate(std::uint32_t face) const
+    {
+        const std::uint32_t i0 = indices[3*face], i1 = indices[3*face + 1], i2 = indices[3*face + 2];
+        const int n = 1 << level; //segments per edge
+
+        //(n+1)(n+2)/2 vertices on a barycentric grid, row i has n-i+1 vertices
+        std::vector<point3> grid;
+        grid.reserve((n + 1) * (n + 2) / 2);
+        for (int i = 0; i <= n; i++)
+        {
+            for (int j = 0; j <= n - i; j++)
+            {
+                real b1 = static_cast<real>(i) / n;
+                real b2 = static_cast<real>(j) / n;
+                real b0 = 1 - b1 - b2;
+                point3 p = b0 * points[i0] + b1 * points[i1] + b2 * points[i2];
+                vec3 normal = b0 * normals[i0] + b1 * normals[i1] + b2 * normals[i2];
+                if (normal.length_squared() > 0) normal = unit_vector(normal);
+                grid.push_back(p + displacement(p, normal) * normal);
+            }
+        }
+        auto vertex = [n, &grid](int i, int j) -> const point3&
+        {
+            //rows before i hold (n+1) + n + ... + (n-i+2) vertices
+            return grid[i * (n + 1) - i * (i - 1) / 2 + j];
+        };
+
+        hittable_list tris;
+        for (int i = 0; i < n; i++)
+        {
+            for (int j = 0; j < n - i; j++)
+            {
+                tris.add(make_shared<triangle>(vertex(i, j), vertex(i + 1, j), vertex(i, j + 1), mat));
+                if (i + j < n - 1)
+                {
+                    tris.add(make_shared<triangle>(vertex(i + 1, j), vertex(i + 1, j + 1), vertex(i, j + 1), mat));
+                }
+            }
+        }
+
+        //triangle, its bvh_node, and the shared_ptr control blocks/list slots for both
+        size_t bytes = tris.objects.size() * (sizeof(triangle) + sizeof(bvh_node) + 64);
+        return {make_shared<bvh_node>(tris), bytes};
+    }
+};
+
+#endif //TESSELLATED_MESH_H
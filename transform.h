@@ -0,0 +1,228 @@
+//
+// Created by Faye Yu on 1/10/26.
+//
+
+#ifndef TRANSFORM_H
+#define TRANSFORM_H
+
+#include "hittable.h"
+
+class affine_transform
+{
+/*
+ * 3x4 matrix [A | t], maps p to A*p + t.
+ * the bottom row of a 4x4 affine matrix is always (0, 0, 0, 1) so it isn't stored
+ */
+public:
+    real m[3][4];
+
+    affine_transform() : m{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}} {}
+
+    static affine_transform translation(const vec3& offset)
+    {
+        affine_transform xf;
+        for (int i = 0; i < 3; i++) xf.m[i][3] = offset[i];
+        return xf;
+    }
+    static affine_transform scale(const vec3& s)
+    {
+        affine_transform xf;
+        for (int i = 0; i < 3; i++) xf.m[i][i] = s[i];
+        return xf;
+    }
+    static affine_transform rotation(const vec3& axis, real degrees)
+    {
+        //rodrigues' rotation formula, counterclockwise when looking down the axis towards the origin
+        vec3 a = unit_vector(axis);
+        real radians = degrees_to_radians(degrees);
+        real c = std::cos(radians);
+        real s = std::sin(radians);
+        real k = 1 - c;
+
+        affine_transform xf;
+        xf.m[0][0] = c + a.x()*a.x()*k;
+        xf.m[0][1] = a.x()*a.y()*k - a.z()*s;
+        xf.m[0][2] = a.x()*a.z()*k + a.y()*s;
+        xf.m[1][0] = a.y()*a.x()*k + a.z()*s;
+        xf.m[1][1] = c + a.y()*a.y()*k;
+        xf.m[1][2] = a.y()*a.z()*k - a.x()*s;
+        xf.m[2][0] = a.z()*a.x()*k - a.y()*s;
+        xf.m[2][1] = a.z()*a.y()*k + a.x()*s;
+        xf.m[2][2] = c + a.z()*a.z()*k;
+        return xf;
+    }
+    static affine_transform rotation_y(real degrees)
+    {
+        return rotation(vec3(0, 1, 0), degrees);
+    }
+
+    //composition, (a * b) applies b first and then a
+    affine_transform operator*(const affine_transform& b) const
+    {
+        affine_transform r;
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 4; j++)
+            {
+                r.m[i][j] = m[i][0]*b.m[0][j] + m[i][1]*b.m[1][j] + m[i][2]*b.m[2][j];
+            }
+            r.m[i][3] += m[i][3];
+        }
+        return r;
+    }
+    affine_transform inverse() const
+    {
+        //invert A with cofactors, then the translation is -A^-1 * t
+        affine_transform r;
+        real det = m[0][0] * (m[1][1]*m[2][2] - m[1][2]*m[2][1])
+                 - m[0][1] * (m[1][0]*m[2][2] - m[1][2]*m[2][0])
+                 + m[0][2] * (m[1][0]*m[2][1] - m[1][1]*m[2][0]);
+        real inv_det = 1 / det;
+        r.m[0][0] = (m[1][1]*m[2][2] - m[1][2]*m[2][1]) * inv_det;
+        r.m[0][1] = (m[0][2]*m[2][1] - m[0][1]*m[2][2]) * inv_det;
+        r.m[0][2] = (m[0][1]*m[1][2] - m[0][2]*m[1][1]) * inv_det;
+        r.m[1][0] = (m[1][2]*m[2][0] - m[1][0]*m[2][2]) * inv_det;
+        r.m[1][1] = (m[0][0]*m[2][2] - m[0][2]*m[2][0]) * inv_det;
+        r.m[1][2] = (m[0][2]*m[1][0] - m[0][0]*m[1][2]) * inv_det;
+        r.m[2][0] = (m[1][0]*m[2][1] - m[1][1]*m[2][0]) * inv_det;
+        r.m[2][1] = (m[0][1]*m[2][0] - m[0][0]*m[2][1]) * inv_det;
+        r.m[2][2] = (m[0][0]*m[1][1] - m[0][1]*m[1][0]) * inv_det;
+        for (int i = 0; i < 3; i++)
+        {
+            r.m[i][3] = -(r.m[i][0]*m[0][3] + r.m[i][1]*m[1][3] + r.m[i][2]*m[2][3]);
+        }
+        return r;
+    }
+    //the matrix normals transform with, the inverse transpose of A (no translation)
+    affine_transform normal_matrix() const
+    {
+        affine_transform inv = inverse();
+        affine_transform r;
+        for (int i = 0; i < 3; i++)
+        {
+            for (int j = 0; j < 3; j++) r.m[i][j] = inv.m[j][i];
+        }
+        return r;
+    }
+
+    point3 apply_point(const point3& p) const
+    {
+        return point3(m[0][0]*p.x() + m[0][1]*p.y() + m[0][2]*p.z() + m[0][3],
+                      m[1][0]*p.x() + m[1][1]*p.y() + m[1][2]*p.z() + m[1][3],
+                      m[2][0]*p.x() + m[2][1]*p.y() + m[2][2]*p.z() + m[2][3]);
+    }
+    vec3 apply_vector(const vec3& v) const
+    {
+        return vec3(m[0][0]*v.x() + m[0][1]*v.y() + m[0][2]*v.z(),
+                    m[1][0]*v.x() + m[1][1]*v.y() + m[1][2]*v.z(),
+                    m[2][0]*v.x() + m[2][1]*v.y() + m[2][2]*v.z());
+    }
+    //error bound of apply_point(p), given p already has error p_error (pbrt 6.8.4)
+    vec3 apply_point_error(const point3& p, const vec3& p_error) const
+    {
+        vec3 e;
+        for (int i = 0; i < 3; i++)
+        {
+            real carried = std::fabs(m[i][0])*p_error.x() + std::fabs(m[i][1])*p_error.y() + std::fabs(m[i][2])*p_error.z();
+            real rounding = std::fabs(m[i][0]*p.x()) + std::fabs(m[i][1]*p.y()) + std::fabs(m[i][2]*p.z()) + std::fabs(m[i][3]);
+            e[i] = (1 + error_gamma(3)) * carried + error_gamma(3) * rounding;
+        }
+        return e;
+    }
+    aabb apply(const aabb& bbox) const
+    {
+        //transform all 8 corners and box them
+        point3 min(infinity, infinity, infinity);
+        point3 max(-infinity, -infinity, -infinity);
+        for (int i = 0; i < 2; i++)
+        {
+            for (int j = 0; j < 2; j++)
+            {
+                for (int k = 0; k < 2; k++)
+                {
+                    auto corner = point3(i ? bbox.x.max : bbox.x.min, j ? bbox.y.max : bbox.y.min, k ? bbox.z.max : bbox.z.min);
+                    point3 p = apply_point(corner);
+                    for (int a = 0; a < 3; a++)
+                    {
+                        min[a] = std::fmin(p[a], min[a]);
+                        max[a] = std::fmax(p[a], max[a]);
+                    }
+                }
+            }
+        }
+        return aabb(min, max);
+    }
+};
+
+class transform : public hittable
+{
+/*
+ * places an object in the world with an arbitrary affine transform (translate, rotate about any axis, scale).
+ * wrapping a transform in another transform multiplies the matrices here,
+ * so a chain of them still costs one hop and one ray rebuild per hit
+ */
+public:
+    transform(shared_ptr<hittable> p, const affine_transform& object_to_world)
+    {
+        if (auto inner = std::dynamic_pointer_cast<transform>(p))
+        {
+            object = inner->object;
+            to_world = object_to_world * inner->to_world;
+        }
+        else
+        {
+            object = std::move(p);
+            to_world = object_to_world;
+        }
+        to_object = to_world.inverse();
+        normal_to_world = to_world.normal_matrix();
+        //boxing the innermost object's bbox once is tighter than re-boxing an already rotated bbox
+        bbox = to_world.apply(object->bounding_box());
+    }
+
+    bool hit(const ray& r, interval ray_t, hit_record& rec) const override
+    {
+        //move the ray into object space. direction isn't normalized so t means the same in both spaces
+        ray object_ray(to_object.apply_point(r.origin()), to_object.apply_vector(r.direction()));
+        object_ray.set_eta(r.current_ior());
+
+        if (!object->hit(object_ray, ray_t, rec)) return false;
+
+        //move the hit back into world space
+        rec.p_error = to_world.apply_point_error(rec.p, rec.p_error);
+        rec.p = to_world.apply_point(rec.p);
+        rec.normal = unit_vector(normal_to_world.apply_vector(rec.normal));
+        rec.shading_normal = unit_vector(normal_to_world.apply_vector(rec.shading_normal));
+        return true;
+    }
+    aabb bounding_box() const override
+    {
+        return bbox;
+    }
+    const shared_ptr<hittable>& inner() const
+    {
+        return object;
+    }
+private:
+    shared_ptr<hittable> object;
+    affine_transform to_world;
+    affine_transform to_object;
+    affine_transform normal_to_world;
+    aabb bbox;
+};
+
+//shorthands for building transforms one step at a time, nested calls collapse into one transform
+inline shared_ptr<hittable> translate(shared_ptr<hittable> p, const vec3& offset)
+{
+    return make_shared<transform>(std::move(p), affine_transform::translation(offset));
+}
+inline shared_ptr<hittable> rotate_y(shared_ptr<hittable> p, real angle)
+{
+    return make_shared<transform>(std::move(p), affine_transform::rotation_y(angle));
+}
+inline shared_ptr<hittable> scale(shared_ptr<hittable> p, const vec3& factors)
+{
+    return make_shared<transform>(std::move(p), affine_transform::scale(factors));
+}
+
+#endif //TRANSFORM_H
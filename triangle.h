@@ -5,7 +5,7 @@
 #ifndef TRIANGLE_H
 #define TRIANGLE_H
 
-#include "triangle_mesh.h"
+#include "hittable.h"
 
 class triangle : public hittable
 {
@@ -17,7 +17,7 @@ public:
      * @param v2
      * @param mat
      */
-    triangle(const point3& v0, const point3& v1, const point3& v2, const shared_ptr<material>& mat)
+    triangle(const point3& v0, const point3& v1, const point3& v2, material_id mat)
     : v0(v0), v1(v1), v2(v2), mat(mat)
     {
         vec3 n = cross(v1 - v0, v2 - v0);
@@ -35,7 +35,7 @@ public:
         if (std::fabs(denom) < 1e-8) return false; //ray is parallel to the plane the triangle is in
 
         auto t = (D - dot(normal, r.origin()))/denom;
-        if (!ray_t.contains(t)) return false; //intersection time is outside valid interval (ex: neg)
+        if (!ray_t.surrounds(t)) return false; //intersection time is outside valid interval (ex: neg)
 
         auto hit_point = r.at(t);
 
@@ -50,13 +50,42 @@ public:
         if (dot(cross(v2v0, v2P), normal) < 0){ return false;}
 
         rec.t = t;
-        rec.p = r.at(t);
+        //project the hit back onto the plane so its error doesn't depend on t (pbrt 6.8.5)
+        rec.p = hit_point - (dot(normal, hit_point) - D) * normal;
+        rec.p_error = error_gamma(8) * (abs(rec.p) + std::fabs(D) * abs(normal));
         rec.set_face_normal(r, normal);
         rec.mat = mat;
         rec.incident_eta = r.current_ior();
 
         return true;
     }
+    //uniform over the triangle
+    point3 get_random_point() const
+    {
+        return random_point(v0, v1, v2, random_double(), random_double());
+    }
+    real get_area() const
+    {
+        return cross(v1 - v0, v2 - v0).length() / 2;
+    }
+    vec3 n() const
+    {
+        return normal;
+    }
+    material_id get_material() const
+    {
+        return mat;
+    }
+    //uniform point from two uniform numbers, folding the unit square onto the triangle's half of it
+    static point3 random_point(const point3& p0, const point3& p1, const point3& p2, double u1, double u2)
+    {
+        if (u1 + u2 > 1)
+        {
+            u1 = 1 - u1;
+            u2 = 1 - u2;
+        }
+        return p0 + real(u1) * (p1 - p0) + real(u2) * (p2 - p0);
+    }
     std::string to_string() const
     {
         return v0.to_string() + " " + v1.to_string() + " " + v2.to_string();
@@ -67,9 +96,9 @@ private:
     const point3 v1;
     const point3 v2;
     vec3 normal;
-    shared_ptr<material> mat;
+    material_id mat;
     aabb bbox;
-    double D;
+    real D;
 };
 
 #endif //TRIANGLE_H
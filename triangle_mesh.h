@@ -5,37 +5,489 @@
 #ifndef MESH_H
 #define MESH_H
 
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <span>
 #include <utility>
+#include <vector>
 
+#include "flat_bvh.h"
 #include "hittable.h"
-#include "hittable_list.h"
+#include "mapped_file.h"
+#include "quantization.h"
 
 class triangle_mesh : public hittable
 {
 /*
- * remember you need mesh to also be a bvh node. this is done in main.cpp
+ * indexed triangle mesh with its own flat bvh, so it goes into a scene as a single hittable.
+ * vertices are stored either at full precision (~72 bytes: position, normal and uv as vec3s)
+ * or quantized (16 bytes: 63 bit position relative to the mesh bounds, octahedral normal, 16 bit uv)
+ * and decoded on the fly when a ray tests a triangle or shades a hit.
+ * everything is read through spans, which point either at arrays the mesh owns or into a memory mapped mesh_file.
+ * triangles can use different materials: each triangle has a material slot, and triangles are stored sorted
+ * into one contiguous range per slot (the bvh never mixes slots in a leaf), so work can be batched by material
  */
 public:
-    hittable_list triangles;
-    triangle_mesh(hittable_list tris, std::vector<point3> v, std::vector<point3> vt,
-        std::vector<point3> vn, const shared_ptr<material>& mat) : triangles(std::move(tris)),
-    v(std::move(v)), vt(std::move(vt)), vn(std::move(vn))
+    static constexpr std::uint32_t max_leaf_size = 4;
+
+    struct material_range
+    {
+        std::uint32_t first_triangle; //the range runs until the next range's first_triangle
+        std::uint32_t slot;
+    };
+
+    /**
+     * @param positions
+     * @param normals one per position, or empty if the mesh has no vertex normals
+     * @param uvs one per position (z is unused), or empty if the mesh has no texture coords
+     * @param indices 3 per triangle, CCW, into the vertex arrays
+     * @param mat
+     * @param quantize store the compact vertex format instead of the full precision one
+     */
+    triangle_mesh(std::vector<point3> positions, std::vector<vec3> normals, std::vector<point3> uvs,
+                  std::vector<std::uint32_t> indices, material_id mat, bool quantize = false) :
+    triangle_mesh(std::move(positions), std::move(normals), std::move(uvs), std::move(indices), {}, {mat}, quantize)
     {}
-    //we copy these variables to prevent them from becoming dangling refs
-    //ex: v, vt, vn are created by obj_loader, mat is shared ptr
+    /**
+     * Mesh with more than one material
+     * @param triangle_slots material slot of each triangle, or empty to put every triangle in slot 0
+     * @param slot_materials the material each slot uses
+     */
+    triangle_mesh(std::vector<point3> positions, std::vector<vec3> normals, std::vector<point3> uvs,
+                  std::vector<std::uint32_t> indices, const std::vector<std::uint32_t>& triangle_slots,
+                  std::vector<material_id> slot_materials, bool quantize = false) :
+    slot_materials(std::move(slot_materials))
+    {
+        owned.positions = std::move(positions);
+        owned.normals = std::move(normals);
+        owned.uvs = std::move(uvs);
+        owned.indices = std::move(indices);
+        if (quantize) compress();
+        sort_by_slot(triangle_slots);
+        view_owned();
+        build_bvh();
+    }
+    /**
+     * Mesh whose bvh was built already (ex: by a loader while it was still reading the file)
+     * @param triangle_slots material slot of each triangle, or empty to put every triangle in slot 0.
+     * a slot's triangles can be in several runs, as long as no leaf of the bvh mixes runs
+     * @param slot_materials the material each slot uses
+     * @param prebuilt bvh over the triangles in indices order, with its prim_indices. a slot's triangles can be in
+     * several runs (ex: one per parse chunk) as long as no leaf mixes slots, the runs get moved together into one range
+     * @param codec if given the mesh is quantized with it, and prebuilt's bounds must hold the decoded positions
+     */
+    triangle_mesh(std::vector<point3> positions, std::vector<vec3> normals, std::vector<point3> uvs,
+                  std::vector<std::uint32_t> indices, const std::vector<std::uint32_t>& triangle_slots,
+                  std::vector<material_id> slot_materials, flat_bvh prebuilt,
+                  const std::optional<position_quantizer>& codec) :
+    slot_materials(std::move(slot_materials)), bvh(std::move(prebuilt))
+    {
+        owned.positions = std::move(positions);
+        owned.normals = std::move(normals);
+        owned.uvs = std::move(uvs);
+        owned.indices = std::move(indices);
+        if (codec) compress(*codec);
+        find_runs(triangle_slots);
+        merge_runs();
+        view_owned();
+        store_in_leaf_order();
+    }
+    //the bvh and spans point into the mesh's own arrays
+    triangle_mesh(const triangle_mesh&) = delete;
+    triangle_mesh& operator=(const triangle_mesh&) = delete;
+
+    /**
+     * Another mesh with the same geometry but its own material slots, ex: one asset used with different materials.
+     * nothing is copied, the new mesh reads source's arrays and bvh and keeps source alive
+     * @param source
+     * @return the new mesh, starting out with source's slot materials
+     */
+    static shared_ptr<triangle_mesh> share(const shared_ptr<const triangle_mesh>& source)
+    {
+        //private constructor, so no make_shared
+        auto mesh = shared_ptr<triangle_mesh>(new triangle_mesh());
+        mesh->positions = source->positions;
+        mesh->normals = source->normals;
+        mesh->uvs = source->uvs;
+        mesh->packed_positions = source->packed_positions;
+        mesh->packed_normals = source->packed_normals;
+        mesh->packed_uvs = source->packed_uvs;
+        mesh->indices = source->indices;
+        mesh->ranges = source->ranges;
+        mesh->quantized = source->quantized;
+        mesh->position_codec = source->position_codec;
+        mesh->uv_codec = source->uv_codec;
+        mesh->slot_materials = source->slot_materials;
+        mesh->bvh.attach(source->bvh.nodes(), source->bvh.tree_depth());
+        mesh->source = source;
+        return mesh;
+    }
+
     bool hit(const ray& r, interval ray_t, hit_record& rec) const override
     {
-        bool b = triangles.hit(r, ray_t, rec);
-        return b;
+        std::uint32_t closest = 0;
+        real b1 = 0, b2 = 0;
+        bool hit_anything = bvh.traverse(r, ray_t, [&](std::uint32_t first, std::uint32_t count, interval& t)
+        {
+            bool hit_leaf = false;
+            for (std::uint32_t tri = first; tri < first + count; tri++)
+            {
+                if (hit_triangle(r, tri, t, b1, b2))
+                {
+                    closest = tri;
+                    rec.t = t.max;
+                    hit_leaf = true;
+                }
+            }
+            return hit_leaf;
+        });
+        if (!hit_anything) return false;
+
+        fill_record(r, closest, b1, b2, rec);
+        return true;
+    }
+
+    aabb bounding_box() const override { return bvh.bounding_box(); }
+
+    size_t num_triangles() const { return indices.size() / 3; }
+    size_t num_vertices() const { return quantized ? packed_positions.size() : positions.size(); }
+    //memory used by the vertex attributes, not counting indices or the bvh
+    size_t vertex_bytes() const
+    {
+        return positions.size() * sizeof(point3) + normals.size() * sizeof(vec3) + uvs.size() * sizeof(point3)
+             + packed_positions.size() * sizeof(std::uint64_t) + packed_normals.size() * sizeof(std::uint32_t)
+             + packed_uvs.size() * sizeof(std::uint32_t);
+    }
+
+    point3 position(std::uint32_t vertex) const
+    {
+        return quantized ? position_codec.decode(packed_positions[vertex]) : positions[vertex];
+    }
+    bool has_normals() const { return !normals.empty() || !packed_normals.empty(); }
+    vec3 normal(std::uint32_t vertex) const
+    {
+        return quantized ? decode_octahedral(packed_normals[vertex]) : normals[vertex];
+    }
+    bool has_uvs() const { return !uvs.empty() || !packed_uvs.empty(); }
+    point3 uv(std::uint32_t vertex) const
+    {
+        return quantized ? uv_codec.decode(packed_uvs[vertex]) : uvs[vertex];
+    }
+
+    //corners of triangle tri, in the mesh's stored order (see material_ranges())
+    void triangle_positions(std::uint32_t tri, point3& p0, point3& p1, point3& p2) const
+    {
+        p0 = position(indices[3*tri]);
+        p1 = position(indices[3*tri + 1]);
+        p2 = position(indices[3*tri + 2]);
     }
 
-    aabb bounding_box() const override {return triangles.bounding_box();}
+    std::span<const material_range> material_ranges() const { return ranges; }
+    size_t num_material_slots() const { return slot_materials.size(); }
+    void set_slot_material(std::uint32_t slot, material_id mat) { slot_materials[slot] = mat; }
+    material_id slot_material(std::uint32_t slot) const { return slot_materials[slot]; }
 private:
-    //const int nTriangles;
-    //const int nVertices;
-    std::vector<point3> v;
-    std::vector<point3> vt;
-    std::vector<point3> vn;
+    friend class mesh_file;
+
+    //arrays built in memory, empty when the mesh is mapped from a file
+    struct arrays
+    {
+        std::vector<point3> positions;
+        std::vector<vec3> normals;
+        std::vector<point3> uvs;
+        std::vector<std::uint64_t> packed_positions;
+        std::vector<std::uint32_t> packed_normals;
+        std::vector<std::uint32_t> packed_uvs;
+        std::vector<std::uint32_t> indices;
+        std::vector<material_range> ranges;
+    };
+    arrays owned;
+    shared_ptr<mapped_file> file; //keeps the mapping alive for a mapped mesh
+    shared_ptr<const triangle_mesh> source; //keeps the geometry alive for a mesh made by share()
+
+    std::span<const point3> positions;
+    std::span<const vec3> normals;
+    std::span<const point3> uvs;
+    std::span<const std::uint64_t> packed_positions;
+    std::span<const std::uint32_t> packed_normals;
+    std::span<const std::uint32_t> packed_uvs;
+    std::span<const std::uint32_t> indices;
+    std::span<const material_range> ranges;
+
+    bool quantized = false;
+    position_quantizer position_codec;
+    uv_quantizer uv_codec;
+    std::vector<material_id> slot_materials; //always owned, ids belong to the scene's registry and not to a file
+    flat_bvh bvh;
+
+    //for mesh_file and share(), which fill in the spans themselves
+    triangle_mesh() = default;
+
+    void view_owned()
+    {
+        positions = owned.positions;
+        normals = owned.normals;
+        uvs = owned.uvs;
+        packed_positions = owned.packed_positions;
+        packed_normals = owned.packed_normals;
+        packed_uvs = owned.packed_uvs;
+        indices = owned.indices;
+        ranges = owned.ranges;
+    }
+
+    //records where each run of triangles with the same slot starts, in the order they're in
+    void find_runs(const std::vector<std::uint32_t>& triangle_slots)
+    {
+        owned.ranges.clear();
+        for (std::uint32_t tri = 0; tri < triangle_slots.size(); tri++)
+        {
+            if (owned.ranges.empty() || owned.ranges.back().slot != triangle_slots[tri])
+            {
+                owned.ranges.push_back({tri, triangle_slots[tri]});
+            }
+        }
+        if (owned.ranges.empty()) owned.ranges = {{0, 0}};
+    }
+
+    //moves the bvh's runs of a slot next to each other so every slot has one range, keeping them in order within the slot.
+    //a run is moved as a whole, so its leaves only need their offsets shifted
+    void merge_runs()
+    {
+        auto by_slot = [](const material_range& a, const material_range& b){ return a.slot < b.slot; };
+        if (std::is_sorted(owned.ranges.begin(), owned.ranges.end(), by_slot)) return;
+
+        std::vector<material_range> runs = std::move(owned.ranges);
+        std::vector<std::uint32_t> order(runs.size());
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b){ return by_slot(runs[a], runs[b]); });
+
+        std::vector<std::uint32_t> merged;
+        merged.reserve(bvh.prim_indices.size());
+        std::vector<std::uint32_t> new_start(runs.size());
+        owned.ranges.clear();
+        for (std::uint32_t r : order)
+        {
+            std::uint32_t first = runs[r].first_triangle;
+            auto last = r + 1 < runs.size() ? runs[r + 1].first_triangle : static_cast<std::uint32_t>(bvh.prim_indices.size());
+            new_start[r] = static_cast<std::uint32_t>(merged.size());
+            if (owned.ranges.empty() || owned.ranges.back().slot != runs[r].slot)
+            {
+                owned.ranges.push_back({new_start[r], runs[r].slot});
+            }
+            merged.insert(merged.end(), bvh.prim_indices.begin() + first, bvh.prim_indices.begin() + last);
+        }
+        bvh.prim_indices = std::move(merged);
+        bvh.move_leaves([&](std::uint32_t offset)
+        {
+            //the run the leaf is in
+            auto it = std::upper_bound(runs.begin(), runs.end(), offset,
+                [](std::uint32_t t, const material_range& run){ return t < run.first_triangle; });
+            auto r = static_cast<std::uint32_t>(std::prev(it) - runs.begin());
+            return new_start[r] + offset - runs[r].first_triangle;
+        });
+    }
+
+    //stable sorts triangles by slot and records where each slot's range starts
+    void sort_by_slot(const std::vector<std::uint32_t>& triangle_slots)
+    {
+        if (triangle_slots.empty())
+        {
+            owned.ranges = {{0, 0}};
+            return;
+        }
+        std::vector<std::uint32_t> order(owned.indices.size() / 3);
+        std::iota(order.begin(), order.end(), 0);
+        std::stable_sort(order.begin(), order.end(),
+            [&](std::uint32_t a, std::uint32_t b){ return triangle_slots[a] < triangle_slots[b]; });
+
+        std::vector<std::uint32_t> sorted(owned.indices.size());
+        owned.ranges.clear();
+        for (std::uint32_t i = 0; i < order.size(); i++)
+        {
+            std::uint32_t tri = order[i];
+            for (int k = 0; k < 3; k++) sorted[3*i + k] = owned.indices[3*tri + k];
+            if (owned.ranges.empty() || owned.ranges.back().slot != triangle_slots[tri])
+            {
+                owned.ranges.push_back({i, triangle_slots[tri]});
+            }
+        }
+        owned.indices = std::move(sorted);
+    }
+
+    std::uint32_t slot_of(std::uint32_t tri) const
+    {
+        if (ranges.size() == 1) return ranges[0].slot;
+        //last range starting at or before tri
+        auto it = std::upper_bound(ranges.begin(), ranges.end(), tri,
+            [](std::uint32_t t, const material_range& range){ return t < range.first_triangle; });
+        return std::prev(it)->slot;
+    }
+
+    void compress()
+    {
+        aabb bounds = aabb::empty;
+        for (const point3& p : owned.positions) bounds = aabb(bounds, aabb(p, p));
+        compress(position_quantizer(bounds));
+    }
+    void compress(const position_quantizer& codec)
+    {
+        position_codec = codec;
+        owned.packed_positions.reserve(owned.positions.size());
+        for (const point3& p : owned.positions) owned.packed_positions.push_back(position_codec.encode(p));
+
+        owned.packed_normals.reserve(owned.normals.size());
+        for (const vec3& n : owned.normals) owned.packed_normals.push_back(encode_octahedral(n));
+
+        if (!owned.uvs.empty())
+        {
+            real u_min = infinity, u_max = -infinity, v_min = infinity, v_max = -infinity;
+            for (const point3& t : owned.uvs)
+            {
+                u_min = std::fmin(u_min, t.x());
+                u_max = std::fmax(u_max, t.x());
+                v_min = std::fmin(v_min, t.y());
+                v_max = std::fmax(v_max, t.y());
+            }
+            uv_codec = uv_quantizer(u_min, u_max, v_min, v_max);
+            owned.packed_uvs.reserve(owned.uvs.size());
+            for (const point3& t : owned.uvs) owned.packed_uvs.push_back(uv_codec.encode(t.x(), t.y()));
+        }
+
+        quantized = true;
+        //free the full precision copies, that's the point
+        owned.positions = std::vector<point3>();
+        owned.normals = std::vector<vec3>();
+        owned.uvs = std::vector<point3>();
+    }
+
+    void build_bvh()
+    {
+        //bounds come from the decoded positions so they match what hit_triangle tests against
+        std::vector<aabb> bounds;
+        bounds.reserve(num_triangles());
+        for (std::uint32_t tri = 0; tri < num_triangles(); tri++)
+        {
+            point3 p0 = position(indices[3*tri]);
+            point3 p1 = position(indices[3*tri + 1]);
+            point3 p2 = position(indices[3*tri + 2]);
+            bounds.emplace_back(aabb(p0, p1), aabb(p2, p2));
+        }
+        //splitting on slot boundaries keeps each slot's triangles in its range through the leaf order shuffle
+        std::vector<std::uint32_t> group_starts;
+        for (size_t r = 1; r < ranges.size(); r++) group_starts.push_back(ranges[r].first_triangle);
+        bvh.build(bounds, max_leaf_size, std::move(group_starts));
+        store_in_leaf_order();
+    }
+
+    void store_in_leaf_order()
+    {
+        //store triangles in leaf order so leaf ranges index the triangles directly
+        std::vector<std::uint32_t> sorted(owned.indices.size());
+        for (size_t i = 0; i < bvh.prim_indices.size(); i++)
+        {
+            std::uint32_t tri = bvh.prim_indices[i];
+            for (int k = 0; k < 3; k++) sorted[3*i + k] = owned.indices[3*tri + k];
+        }
+        bvh.prim_indices.clear();
+        bvh.prim_indices.shrink_to_fit();
+
+        //renumber vertices in the order the sorted triangles first use them,
+        //so a leaf's vertices are close together too (fewer cache misses, and fewer page faults when mapped)
+        constexpr std::uint32_t unused = ~std::uint32_t(0);
+        std::vector<std::uint32_t> new_vertex(num_vertices(), unused);
+        std::vector<std::uint32_t> order;
+        order.reserve(num_vertices());
+        for (std::uint32_t& v : sorted)
+        {
+            if (new_vertex[v] == unused)
+            {
+                new_vertex[v] = static_cast<std::uint32_t>(order.size());
+                order.push_back(v);
+            }
+            v = new_vertex[v];
+        }
+        owned.indices = std::move(sorted);
+        reorder(owned.positions, order);
+        reorder(owned.normals, order);
+        reorder(owned.uvs, order);
+        reorder(owned.packed_positions, order);
+        reorder(owned.packed_normals, order);
+        reorder(owned.packed_uvs, order);
+        view_owned();
+    }
+
+    //keeps only the vertices in order, in that order
+    template <typename T>
+    static void reorder(std::vector<T>& arr, const std::vector<std::uint32_t>& order)
+    {
+        if (arr.empty()) return;
+        std::vector<T> sorted;
+        sorted.reserve(order.size());
+        for (std::uint32_t v : order) sorted.push_back(arr[v]);
+        arr = std::move(sorted);
+    }
+
+    //moller-trumbore, on a hit shrinks ray_t.max to the hit time and writes the barycentrics of v1 and v2
+    bool hit_triangle(const ray& r, std::uint32_t tri, interval& ray_t, real& b1, real& b2) const
+    {
+        point3 p0 = position(indices[3*tri]);
+        vec3 e1 = position(indices[3*tri + 1]) - p0;
+        vec3 e2 = position(indices[3*tri + 2]) - p0;
+
+        vec3 pvec = cross(r.direction(), e2);
+        real det = dot(e1, pvec);
+        if (det == 0) return false; //ray is parallel to the triangle
+        real inv_det = 1 / det;
+
+        vec3 tvec = r.origin() - p0;
+        real u = dot(tvec, pvec) * inv_det;
+        if (u < 0 || u > 1) return false;
+
+        vec3 qvec = cross(tvec, e1);
+        real v = dot(r.direction(), qvec) * inv_det;
+        if (v < 0 || u + v > 1) return false;
+
+        real t = dot(e2, qvec) * inv_det;
+        if (!ray_t.surrounds(t)) return false;
+
+        ray_t.max = t;
+        b1 = u;
+        b2 = v;
+        return true;
+    }
+
+    void fill_record(const ray& r, std::uint32_t tri, real b1, real b2, hit_record& rec) const
+    {
+        std::uint32_t i0 = indices[3*tri], i1 = indices[3*tri + 1], i2 = indices[3*tri + 2];
+        point3 p0 = position(i0), p1 = position(i1), p2 = position(i2);
+        real b0 = 1 - b1 - b2;
+
+        //the point from barycentrics has an error bound that doesn't depend on t (pbrt 6.8.5)
+        rec.p = b0 * p0 + b1 * p1 + b2 * p2;
+        rec.p_error = error_gamma(7) * (abs(b0 * p0) + abs(b1 * p1) + abs(b2 * p2));
+        rec.set_face_normal(r, unit_vector(cross(p1 - p0, p2 - p0)));
+        rec.mat = slot_materials[slot_of(tri)];
+        rec.incident_eta = r.current_ior();
+
+        //only the closest hit gets its normal and uv decoded
+        if (has_normals())
+        {
+            vec3 n = b0 * normal(i0) + b1 * normal(i1) + b2 * normal(i2);
+            if (n.length_squared() > 0)
+            {
+                //keep it on the same side as the geometric normal
+                n = unit_vector(n);
+                rec.shading_normal = dot(n, rec.normal) < 0 ? -n : n;
+            }
+        }
+        if (has_uvs())
+        {
+            point3 t = b0 * uv(i0) + b1 * uv(i1) + b2 * uv(i2);
+            rec.u = t.x();
+            rec.v = t.y();
+        }
+    }
 };
 
 #endif //MESH_H
@@ -6,39 +6,46 @@
 #define VEC3_H
 
 #include <random>
+#include <string>
+#include <type_traits>
 
-class vec3 {
+//T is the scalar type, see real in rtweekend.h
+template <typename T>
+class basic_vec3 {
 public:
-    double e[3];
+    T e[3];
 
-    vec3() : e{0, 0, 0} {}
-    vec3(double e0, double e1, double e2) : e{e0, e1, e2} {}
+    basic_vec3() : e{0, 0, 0} {}
+    basic_vec3(T e0, T e1, T e2) : e{e0, e1, e2} {}
+    //explicit so mixing precisions is always visible
+    template <typename U>
+    explicit basic_vec3(const basic_vec3<U>& v) : e{static_cast<T>(v.e[0]), static_cast<T>(v.e[1]), static_cast<T>(v.e[2])} {}
 
-    double x() const { return e[0];}
-    double y() const { return e[1];}
-    double z() const { return e[2];}
+    T x() const { return e[0];}
+    T y() const { return e[1];}
+    T z() const { return e[2];}
 
-    vec3 operator-() const {return vec3(-e[0], -e[1], -e[2]);}
-    double operator[](int i) const{ return e[i];}
-    double& operator[](int i) {return e[i];}
+    basic_vec3 operator-() const {return basic_vec3(-e[0], -e[1], -e[2]);}
+    T operator[](int i) const{ return e[i];}
+    T& operator[](int i) {return e[i];}
 
-    vec3& operator+=(const vec3& v) {
+    basic_vec3& operator+=(const basic_vec3& v) {
         e[0] += v.e[0]; e[1] += v.e[1]; e[2] += v.e[2];
         return *this;
     }
-    vec3& operator*=(double t) {
+    basic_vec3& operator*=(T t) {
         e[0]*= t;
         e[1]*= t;
         e[2]*= t;
         return *this;
     }
-    vec3& operator/=(double t) {
+    basic_vec3& operator/=(T t) {
         return *this *= 1/t;
     }
-    double length() const {
+    T length() const {
         return std::sqrt(length_squared());
     }
-    double length_squared() const {
+    T length_squared() const {
         return e[0]*e[0] + e[1]*e[1] + e[2]*e[2];
     }
     bool near_zero() const
@@ -47,15 +54,15 @@ public:
         auto s = 1e-8;
         return(std::fabs(e[0]) < s) && (std::fabs(e[1]) < s) && (std::fabs(e[2]) < s);
     }
-    static vec3 random()
+    static basic_vec3 random()
     {
-        return vec3(random_double(), random_double(), random_double());
+        return basic_vec3(random_double(), random_double(), random_double());
     }
-    static vec3 random(double min, double max)
+    static basic_vec3 random(double min, double max)
     {
         //basically means you have a vector whose point can be anywhere
         //within a sphere with a hole cut out of it
-        return vec3(random_double(min, max), random_double(min, max), random_double(min, max));
+        return basic_vec3(random_double(min, max), random_double(min, max), random_double(min, max));
     }
     std::string to_string() const
     {
@@ -63,42 +70,68 @@ public:
     }
 };
 
+using vec3 = basic_vec3<real>;
 //point3 is just an alias for vec3, but useful for geometric clarity in the code
 using point3 = vec3;
 
 //Vector utility functions
-inline std::ostream& operator<<(std::ostream& out, const vec3& v) {
+//scalar params are std::type_identity_t so ex: a double times a float vec3 still deduces T from the vector
+template <typename T>
+inline std::ostream& operator<<(std::ostream& out, const basic_vec3<T>& v) {
     return out << v.e[0] << " " << v.e[1] << " " << v.e[2];
 }
-inline vec3 operator+(const vec3& u, const vec3& v) {
-    return(vec3(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]));
+template <typename T>
+inline bool operator==(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return u.e[0] == v.e[0] && u.e[1] == v.e[1] && u.e[2] == v.e[2];
 }
-inline vec3 operator-(const vec3& u, const vec3& v) {
-    return vec3(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
+template <typename T>
+inline void hash_combine(std::size_t& seed, const basic_vec3<T>& v) {
+    hash_combine(seed, v.e[0]);
+    hash_combine(seed, v.e[1]);
+    hash_combine(seed, v.e[2]);
 }
-inline vec3 operator*(const vec3& u, const vec3& v) {
-    return vec3(u.e[0]*v.e[0], u.e[1]*v.e[1], u.e[2]*v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator+(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return(basic_vec3<T>(u.e[0] + v.e[0], u.e[1] + v.e[1], u.e[2] + v.e[2]));
 }
-inline vec3 operator*(double t, const vec3& v) {
-    return vec3(t * v.e[0], t * v.e[1], t * v.e[2]);
+template <typename T>
+inline basic_vec3<T> operator-(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[0] - v.e[0], u.e[1] - v.e[1], u.e[2] - v.e[2]);
 }
-inline vec3 operator*(const vec3& v, double t) {
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[0]*v.e[0], u.e[1]*v.e[1], u.e[2]*v.e[2]);
+}
+template <typename T>
+inline basic_vec3<T> operator*(std::type_identity_t<T> t, const basic_vec3<T>& v) {
+    return basic_vec3<T>(t * v.e[0], t * v.e[1], t * v.e[2]);
+}
+template <typename T>
+inline basic_vec3<T> operator*(const basic_vec3<T>& v, std::type_identity_t<T> t) {
     return t * v;
 }
-inline vec3 operator/(const vec3& v, double t) {
+template <typename T>
+inline basic_vec3<T> operator/(const basic_vec3<T>& v, std::type_identity_t<T> t) {
     return (1/t) * v;
 }
-inline double dot(const vec3& u, const vec3& v) {
+template <typename T>
+inline T dot(const basic_vec3<T>& u, const basic_vec3<T>& v) {
     return u.e[0]*v.e[0] + u.e[1]*v.e[1] + u.e[2]*v.e[2];
 }
-inline vec3 cross(const vec3& u, const vec3& v) {
-    return vec3(u.e[1] * v.e[2] - u.e[2] * v.e[1],
+template <typename T>
+inline basic_vec3<T> cross(const basic_vec3<T>& u, const basic_vec3<T>& v) {
+    return basic_vec3<T>(u.e[1] * v.e[2] - u.e[2] * v.e[1],
             u.e[2] * v.e[0] - u.e[0] * v.e[2],
             u.e[0] * v.e[1] - u.e[1] * v.e[0]);
 }
-inline vec3 unit_vector(const vec3& v) {
+template <typename T>
+inline basic_vec3<T> unit_vector(const basic_vec3<T>& v) {
     return v / v.length();
 }
+template <typename T>
+inline basic_vec3<T> abs(const basic_vec3<T>& v) {
+    return basic_vec3<T>(std::fabs(v.e[0]), std::fabs(v.e[1]), std::fabs(v.e[2]));
+}
 inline vec3 random_in_unit_disk()
 {
     while (true)
@@ -107,15 +140,30 @@ inline vec3 random_in_unit_disk()
         if (p.length_squared() < 1) return p;
     }
 }
-inline vec3 cos_weighted_random_in_hemisphere()
+//r1 and r2 uniform in [0, 1)
+inline vec3 cos_weighted_random_in_hemisphere(double r1, double r2)
 {
-    double r1 = random_double();
-    double r2 = random_double();
-
     double r = sqrt(r1);
     double phi = 2 * M_PI * r2;
     return vec3(r * cos(phi), r * sin(phi), sqrt(1 - r1));
 }
+inline vec3 cos_weighted_random_in_hemisphere()
+{
+    double r1 = random_double();
+    double r2 = random_double();
+    return cos_weighted_random_in_hemisphere(r1, r2);
+}
+//rand() gives uniform doubles in [0, 1), ex: a generator of its own instead of the shared one behind random_double
+template <typename Rand>
+inline vec3 random_unit_vector(Rand&& rand)
+{
+    while (true)
+    {
+        vec3 v(2 * rand() - 1, 2 * rand() - 1, 2 * rand() - 1);
+        double lensq = v.length_squared();
+        if (1e-160 < lensq && lensq <= 1) return v / sqrt(lensq);
+    }
+}
 inline vec3 random_unit_vector()
 {
     //Generate a random vector whose tip is on the unit sphere
@@ -130,17 +178,19 @@ inline vec3 random_on_hemisphere(const vec3& normal){
     if(dot(rand, normal) > 0.0) return rand;
     return -rand;
 }
-inline vec3 reflect(const vec3& v, const vec3& n)
+template <typename T>
+inline basic_vec3<T> reflect(const basic_vec3<T>& v, const basic_vec3<T>& n)
 {
     return v - 2*dot(n, v)*n;
 }
-inline vec3 refract(const vec3& uv, const vec3& n, double etai_over_etat)
+template <typename T>
+inline basic_vec3<T> refract(const basic_vec3<T>& uv, const basic_vec3<T>& n, std::type_identity_t<T> etai_over_etat)
 {
     //just reference raytracing in one weekend ch 11 for the math
     //uses snell's law
-    auto cos_theta = std::fmin(dot(-uv, n), 1.0);
-    vec3 r_out_perp = etai_over_etat * (uv + cos_theta * n);
-    vec3 r_out_parallel = -std::sqrt(std::fabs(1.0 - r_out_perp.length_squared())) * n;
+    T cos_theta = std::fmin(dot(-uv, n), T(1));
+    basic_vec3<T> r_out_perp = etai_over_etat * (uv + cos_theta * n);
+    basic_vec3<T> r_out_parallel = -std::sqrt(std::fabs(1 - r_out_perp.length_squared())) * n;
     return r_out_perp + r_out_parallel;
 }
 